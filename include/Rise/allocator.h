@@ -2,21 +2,60 @@
 #ifndef allocator_h
 #define allocator_h
 
-#include <list>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
 #include <vector>
 
 #ifndef RISE_ALLOCATOR_POOL_SIZE
 #define RISE_ALLOCATOR_POOL_SIZE 1024
 #endif //RISE_ALLOCATOR_POOL_SIZE
 
+// Virtual range reserved by every allocator with the HugePages backend
+#ifndef RISE_ALLOCATOR_REGION_SIZE
+#define RISE_ALLOCATOR_REGION_SIZE (64ull * 1024 * 1024)
+#endif //RISE_ALLOCATOR_REGION_SIZE
+
+#ifndef RISE_ALLOCATOR_MAGAZINE_SIZE
+#define RISE_ALLOCATOR_MAGAZINE_SIZE 64
+#endif //RISE_ALLOCATOR_MAGAZINE_SIZE
+
 namespace Rise {
 
+    // Fixed size block pool. Free blocks are linked through their own memory,
+    // every thread keeps a small magazine of them and returns the surplus
+    // to the shared list without taking a lock.
     class Allocator {
     public:
 
-        Allocator(uint32_t blockSize);
+        enum class Backend {
+            // every pool is a separate heap allocation
+            Heap,
+            // pools are carved one after another from a reserved virtual range
+            // backed by transparent huge pages where the platform has them,
+            // falls back to the heap once the range is used up
+            HugePages,
+        };
+
+#ifdef RISE_ALLOCATOR_HUGE_PAGES
+        static constexpr Backend DefaultBackend = Backend::HugePages;
+#else
+        static constexpr Backend DefaultBackend = Backend::Heap;
+#endif
+
+        struct Statistics {
+            uint32_t blockSize = 0;
+            uint32_t poolSize = 0;
+            uint32_t pools = 0;
+            uint32_t capacity = 0;
+            uint32_t allocated = 0;
+        };
+
+        Allocator(uint32_t blockSize, uint32_t poolSize = RISE_ALLOCATOR_POOL_SIZE, Backend backend = DefaultBackend);
         ~Allocator();
 
+        Allocator(const Allocator&) = delete;
+        Allocator& operator=(const Allocator&) = delete;
 
         template <class T>
         void destroy(T* t) {
@@ -32,18 +71,97 @@ namespace Rise {
         void deallocate(void* ptr);
 
         uint32_t capacity() const {
-            return static_cast<uint32_t>(_pools.size() * RISE_ALLOCATOR_POOL_SIZE);
+            return _capacity.load(std::memory_order_relaxed);
         }
 
         uint32_t freeAllocations() const {
-            return static_cast<uint32_t>(_freeBlocks.size());
+            return capacity() - allocated();
+        }
+
+        // sums up the counts every thread's magazine hasn't handed in yet
+        uint32_t allocated() const;
+
+        uint32_t blockSize() const {
+            return _blockSize;
+        }
+
+        Statistics statistics() const;
+
+        // Releases pools whose blocks are all free. Blocks cached by other threads
+        // keep their pools alive, the calling thread's cache is flushed first.
+        // Returns the number of released pools.
+        uint32_t Trim();
+
+        // Trim on its own once less than `lowWatermark` of the capacity is in use, 0 disables
+        void SetAutoTrim(float lowWatermark) {
+            _autoTrimWatermark.store(lowWatermark, std::memory_order_relaxed);
         }
 
     private:
 
+        struct FreeBlock {
+            FreeBlock* next;
+        };
+
+        struct Magazine {
+            FreeBlock* head = nullptr;
+            uint32_t count = 0;
+            // blocks allocated minus freed through this magazine since it was last folded into _allocated,
+            // written by the owning thread only
+            std::atomic<int32_t> allocated = 0;
+        };
+
+        Magazine& LocalMagazine();
+
+        void Fold(Magazine& magazine);
+        // hands a magazine of an exiting thread back
+        void Release(Magazine& magazine);
+
+        void Refill(Magazine& magazine);
+        void Overflow(Magazine& magazine);
+
+        void PushChain(FreeBlock* first, FreeBlock* last);
+        FreeBlock* CreatePool();
+
+        uint8_t* AcquirePool();
+        void ReleasePool(uint8_t* pool);
+
+        bool ShouldAutoTrim() const;
+        uint32_t FoldedAllocated() const;
+
+        friend struct ThreadMagazines;
+
+        const uint64_t _id;
         const uint32_t _blockSize;
-        std::list<void*> _freeBlocks;
+        const uint32_t _poolSize;
+        const Backend _backend;
+
+        std::atomic<FreeBlock*> _freeBlocks = nullptr;
+        // taking blocks out of _freeBlocks, putting them in is lock free
+        std::mutex _popLock;
+
+        std::atomic<uint32_t> _capacity = 0;
+        std::atomic<uint32_t> _allocated = 0;
+
+        // magazines of every thread using this allocator
+        mutable std::mutex _magazineLock;
+        std::vector<Magazine*> _magazines;
+
+        std::atomic<float> _autoTrimWatermark = 0.0f;
+        std::atomic_flag _trimming;
+        // what the last trim ran at
+        std::atomic<uint32_t> _trimCapacity = 0;
+        std::atomic<uint32_t> _trimAllocated = 0;
+
+        // sorted by address, so free blocks can be mapped back to their pools
+        mutable std::mutex _poolLock;
         std::vector<uint8_t*> _pools;
+
+        // HugePages backend only, guarded by _poolLock as well
+        uint8_t* _region = nullptr;
+        size_t _regionUsed = 0;
+        size_t _poolStride = 0;
+        std::vector<uint8_t*> _regionFreeSlots;
     };
 
 }
@@ -51,7 +51,8 @@ namespace Rise {
 
         Size2D getTextBounding(const std::string& text, uint32_t size) const;
 
-        void LoadFromFile(const std::string& filename);
+        // stops early and stays unloaded once `token` is cancelled
+        void LoadFromFile(const std::string& filename, const CancellationToken& token = {});
 
         void Unload() override;
 
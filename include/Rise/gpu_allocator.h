@@ -3,48 +3,98 @@
 #define gpu_allocator_h
 
 #include "utils.h"
+#include "tlsf.h"
 
 #include <vulkan/vulkan.h>
 
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
 #include <unordered_map>
-#include <set>
 #include <vector>
 #include <shared_mutex>
 
-#ifndef RISE_GPU_ALLOCATOR_BLOCK_SIZE
-#define RISE_GPU_ALLOCATOR_BLOCK_SIZE (1024 * 1024 * 16) 
-#endif //RISE_GPU_ALLOCATOR_BLOCK_SIZE
+#ifndef RISE_GPU_STACK_ALLOCATOR_CHUNK_SIZE
+#define RISE_GPU_STACK_ALLOCATOR_CHUNK_SIZE (1024 * 1024)
+#endif //RISE_GPU_STACK_ALLOCATOR_CHUNK_SIZE
 
 namespace Rise {
 
+    class GpuAliasAllocator;
+
     class GpuAllocator {
     public:
 
+        struct Config {
+            // the first shared block of every memory type, each next one is twice as big
+            VkDeviceSize minBlockSize = 1024 * 1024;
+            VkDeviceSize maxBlockSize = 1024 * 1024 * 16;
+
+            // resources at least this big get a VkDeviceMemory of their own, at most maxBlockSize
+            VkDeviceSize dedicatedThreshold = 1024 * 1024 * 8;
+
+            // shared blocks staying completely free for this many frames are released
+            uint32_t emptyBlockFrames = 120;
+
+            // shared blocks used less than this share are emptied by the defragmenter
+            float defragUsage = 0.25f;
+            // relocations started per Update()
+            uint32_t defragMoves = 4;
+            // frames between searches for a block to empty
+            uint32_t defragInterval = 64;
+
+            // frames a replaced resource stays alive, so that frames in flight can finish with it
+            uint32_t retireFrames = 4;
+
+            // share of a heap's budget after which pressure callbacks are called
+            float pressureThreshold = 0.9f;
+            // frames between two calls while the heap stays under pressure
+            uint32_t pressureInterval = 30;
+
+            // Lets uploads write straight into device local memory the host can see.
+            // On discrete gpus only heaps bigger than the threshold count, smaller ones
+            // are the plain 256MiB BAR window which is too precious for that.
+            bool directWrite = true;
+            VkDeviceSize directWriteMinHeapSize = 1024 * 1024 * 256;
+        };
+
+        // affects blocks created from now on
+        static void SetConfig(const Config& config);
+        static Config config();
+
         struct Buffer {
             Buffer() = default;
 
+            // host visible blocks stay mapped as long as they live, so it's just a pointer
             struct MapPtr {
             public:
-                MapPtr(std::shared_ptr<void> mapPtr, ptrdiff_t offset)
-                    : _offset(offset), _mapPtr(mapPtr) {}
-
-                ~MapPtr();
+                explicit MapPtr(void* ptr)
+                    : _ptr(ptr) {}
 
                 operator void* () const {
                     return ptr();
                 }
 
                 void* ptr() const {
-                    return reinterpret_cast<void*>(reinterpret_cast<uint8_t*>(_mapPtr.get()) + _offset);
+                    return _ptr;
                 }
 
             private:
 
-                ptrdiff_t _offset;
-                std::shared_ptr<void> _mapPtr;
+                void* _ptr;
             };
 
-            MapPtr MapMemory() const;
+            // null unless the memory is host visible
+            MapPtr MapMemory() const {
+                return MapPtr(_mapped);
+            }
+
+            // Non coherent memory needs writes of the host flushed before the gpu reads them
+            // and gpu writes invalidated before the host reads them, no-ops for coherent memory.
+            // The range is relative to the buffer and gets widened to nonCoherentAtomSize.
+            void Flush(VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE) const;
+            void Invalidate(VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE) const;
 
             VkBuffer vBuffer() const {
                 return _vBuffer;
@@ -52,9 +102,12 @@ namespace Rise {
 
         private:
             friend GpuAllocator;
-            Buffer(VkBuffer vBuffer) : _vBuffer(vBuffer) {}
+            Buffer(VkBuffer vBuffer, void* mapped, bool coherent)
+                : _vBuffer(vBuffer), _mapped(mapped), _coherent(coherent) {}
 
             VkBuffer _vBuffer = nullptr;
+            void* _mapped = nullptr;
+            bool _coherent = true;
         };
 
         struct Image {
@@ -66,96 +119,271 @@ namespace Rise {
 
         private:
             friend GpuAllocator;
+            friend GpuAliasAllocator;
             Image(VkImage vImage) : _vImage(vImage) {}
 
             VkImage _vImage = nullptr;
         };
 
         static Buffer CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkMemoryPropertyFlags ignoreProperties = 0);
+        // Device local buffer the host writes into directly (resizable BAR, integrated gpus),
+        // an empty buffer when there is no such memory or its heap is under pressure,
+        // the caller goes through a staging buffer then. Writes need Buffer::Flush().
+        static Buffer CreateDirectWriteBuffer(VkDeviceSize size, VkBufferUsageFlags usage);
         static void DestroyBuffer(Buffer buffer);
 
-        static void CopyBuffer(Buffer srcBuffer, Buffer dstBuffer, VkDeviceSize size);
-
         static Image CreateImage(VkExtent3D& extent, VkFormat format, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkMemoryPropertyFlags ignoreProperties = 0);
         static void DestroyImage(Image image);
 
-        static void CopyBufferToImage(Buffer srcBuffer, VkDeviceSize size, Image dstImage, VkExtent3D& extent);
+        using BufferMoved = std::function<void(Buffer)>;
+        using ImageMoved = std::function<void(Image)>;
+
+        // Ties a relocation callback to its owner, the callback only runs while the guard is alive
+        class RelocationGuard {
+        public:
+            // Waits for a running callback, none runs afterwards.
+            // The owner calls it before it destroys the resource or itself.
+            void Revoke() {
+                std::lock_guard<std::mutex> lg(_lock);
+                _alive = false;
+            }
+
+        private:
+            friend GpuAllocator;
+
+            std::mutex _lock;
+            bool _alive = true;
+        };
+
+        // Allows the defragmenter to move the resource into another block. Its content must not
+        // be written by the gpu anymore and it needs both transfer usages. Once the copy is done
+        // the callback gets the replacement on the thread ticking the upload queue, the old
+        // handle stays valid for Config::retireFrames more frames.
+        // Returns nullptr when the resource can't be relocated.
+        static std::shared_ptr<RelocationGuard> SetRelocatable(Buffer buffer, BufferMoved onMoved);
+        static std::shared_ptr<RelocationGuard> SetRelocatable(Image image, ImageMoved onMoved);
+
+        // Calls `destroy` once frames in flight can't use the object anymore
+        static void Retire(std::function<void()> destroy);
+
+        // Called by the core once per frame: destroys retired resources, releases blocks
+        // which have been empty for a while and moves a few relocatable allocations out
+        // of a sparsely used block, freeing it once it's empty.
+        static void Update();
+
+        struct Statistics {
+            uint32_t memoryType = 0;
+
+            uint32_t blockCount = 0;
+            VkDeviceSize blockBytes = 0;
+            VkDeviceSize blockUsedBytes = 0;
+
+            uint32_t dedicatedCount = 0;
+            VkDeviceSize dedicatedBytes = 0;
+        };
+
+        static std::vector<Statistics> statistics();
+
+        // tags the allocation for reports, e.g. with the file of the resource
+        static void SetOwner(Buffer buffer, const std::string& owner);
+        static void SetOwner(Image image, const std::string& owner);
+
+        struct AllocationReport {
+            VkDeviceSize offset = 0;
+            VkDeviceSize size = 0;
+            bool image = false;
+            bool relocatable = false;
+            std::string owner;
+        };
+
+        struct BlockReport {
+            uint32_t blockIndex = 0;
+            bool dedicated = false;
+
+            VkDeviceSize size = 0;
+            VkDeviceSize usedBytes = 0;
+            VkDeviceSize freeBytes = 0;
+            VkDeviceSize largestFreeRange = 0;
+            // 0 when all free bytes are one range, close to 1 when they are scattered in small pieces
+            float fragmentation = 0.0f;
+
+            // sorted by offset
+            std::vector<AllocationReport> allocations;
+        };
+
+        struct MemoryTypeReport {
+            uint32_t memoryType = 0;
+            uint32_t heap = 0;
+            VkMemoryPropertyFlags properties = 0;
+
+            std::vector<BlockReport> blocks;
+        };
+
+        // a snapshot of every block and allocation, costly, not meant to be called each frame
+        static std::vector<MemoryTypeReport> Report();
+        // same as Report() along with the heap budgets, as json
+        static std::string ReportJson();
+
+        struct HeapBudget {
+            uint32_t heap = 0;
+            VkDeviceSize size = 0;
+
+            // what the process may use, a share of the heap size without VK_EXT_memory_budget
+            VkDeviceSize budget = 0;
+            // by the whole process as reported by the driver, `allocated` without the extension
+            VkDeviceSize usage = 0;
+            // device memory allocated through the GpuAllocator
+            VkDeviceSize allocated = 0;
+        };
+
+        // as of the last Update()
+        static std::vector<HeapBudget> budgets();
+
+        // `bytes` is how much should be freed to get the heap back under the pressure threshold
+        using PressureCallback = std::function<void(uint32_t heap, VkDeviceSize bytes)>;
+
+        // Callbacks are called from Update() without the allocator being locked,
+        // so they may destroy resources right away
+        static uint32_t AddPressureCallback(PressureCallback callback);
+        static void RemovePressureCallback(uint32_t id);
 
         static void Destroy();
 
     private:
 
-        friend class GpuStackAllocator;
+        friend GpuAliasAllocator;
+
         struct AllocationData {
             uint32_t memoryType = std::numeric_limits<uint32_t>::max();
             uint32_t blockIndex = std::numeric_limits<uint32_t>::max();
             VkDeviceSize offset = 0;
             VkDeviceSize size = 0;
+            Tlsf::Handle handle = Tlsf::InvalidHandle;
+
+            // what the resource was created with, so that it can be recreated elsewhere
+            VkFlags usage = 0;
+            VkDeviceSize bufferSize = 0;
+            VkExtent3D extent{};
+            VkFormat format = VK_FORMAT_UNDEFINED;
+
+            // being copied or waiting for retirement, the owner doesn't have it anymore
+            bool moving = false;
+            // destroyed by the owner while moving
+            bool destroyed = false;
+
+            std::string owner;
         };
 
-        static bool Allocate(const VkMemoryRequirements& memRequirements, VkMemoryPropertyFlags properties, VkMemoryPropertyFlags ignoreProperties, VkDeviceMemory& memory, AllocationData& data);
+        template <class Moved>
+        struct Relocation {
+            Moved onMoved;
+            std::shared_ptr<RelocationGuard> guard;
+        };
 
-        static bool FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties, VkMemoryPropertyFlags ignoreProperties, uint32_t& memoryType);
+        // the block the defragmenter is emptying
+        struct Drain {
+            bool active = false;
+            uint32_t memoryType = 0;
+            uint32_t region = 0;
+        };
 
-        struct MemoryData {
+        struct Retired {
+            uint64_t frame = 0;
+            std::function<void()> destroy;
+        };
 
-            struct LogicalBlock {
+        // _allocationLock has to be held, a resource being moved is released once its copy is done
+        static void DestroyBufferLocked(VkBuffer vBuffer);
+        static void DestroyImageLocked(VkImage vImage);
 
-                LogicalBlock(VkDeviceSize size) : _size(size) {}
-                LogicalBlock(uint32_t blockIndex, VkDeviceSize offset, VkDeviceSize size) 
-                    : _blockIndex(blockIndex), _offset(offset), _size(size) {}
+        static void ReleaseBuffer(VkBuffer vBuffer);
+        static void ReleaseImage(VkImage vImage);
 
-                friend bool operator<(const LogicalBlock& lhs, const LogicalBlock& rhs) {
-                    return lhs._blockIndex == std::numeric_limits<uint32_t>::max()
-                        || rhs._blockIndex == std::numeric_limits<uint32_t>::max()
-                        ? lhs._size < rhs._size : lhs._offset < rhs._offset;
-                }
+        static bool PickDrain();
+        static void StopDrain();
+        static void DrainStep();
 
-                uint32_t _blockIndex = std::numeric_limits<uint32_t>::max();
-                VkDeviceSize _offset = 0;
-                VkDeviceSize _size = 0;
+        static bool MoveBuffer(VkBuffer vBuffer);
+        static bool MoveImage(VkImage vImage);
+        static void FinishMove(Buffer oldBuffer, Buffer newBuffer);
+        static void FinishMove(Image oldImage, Image newImage);
 
-            };
+        // dedicatedInfo is not null when the resource has to get memory of its own
+        static bool Allocate(const VkMemoryRequirements& memRequirements, VkMemoryPropertyFlags properties, VkMemoryPropertyFlags ignoreProperties,
+            const VkMemoryDedicatedAllocateInfo* dedicatedInfo, VkDeviceMemory& memory, AllocationData& data);
+        static void Free(const AllocationData& data);
 
-            struct MemoryBlock {
+        // reads the config, _allocationLock has to be held
+        static bool ShouldBeDedicated(const VkMemoryRequirements& memRequirements, const VkMemoryDedicatedRequirements& dedicatedRequirements);
 
-                explicit MemoryBlock(VkDeviceSize size) : _size(size) {}
+        // memoryTypes narrows the types the buffer's memory may come from
+        static Buffer CreateBufferOfTypes(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkMemoryPropertyFlags ignoreProperties, uint32_t memoryTypes);
+        static Buffer MakeBuffer(VkBuffer vBuffer, const AllocationData& data);
+        static VkMappedMemoryRange MappedRange(VkBuffer vBuffer, VkDeviceSize offset, VkDeviceSize size);
 
-                VkDeviceMemory _vMemory;
-                VkDeviceSize _size = 0;
+        // memoryTypes gets a bit for every type direct writes may go to
+        static bool DirectWriteAvailable(uint32_t& memoryTypes);
 
-                std::weak_ptr<void> _mapPtr;
+        static bool FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties, VkMemoryPropertyFlags ignoreProperties, uint32_t& memoryType);
 
-                Buffer::MapPtr MapMemory(ptrdiff_t offset);
+        // every VkDeviceMemory goes through these, so that heaps usage is known
+        static bool AllocateDeviceMemory(const VkMemoryAllocateInfo& allocInfo, VkDeviceMemory& vMemory);
+        static void FreeDeviceMemory(VkDeviceMemory vMemory, VkDeviceSize size, uint32_t memoryType);
 
-                struct Block {
+        static void UpdateBudgets();
+        // heaps under pressure along with the bytes to free
+        static std::vector<std::pair<uint32_t, VkDeviceSize>> CheckPressure(uint64_t frame);
 
-                    Block(VkDeviceSize offset)
-                        : _offset(offset) {}
-                    Block(VkDeviceSize offset, VkDeviceSize size)
-                        : _offset(offset), _size(size) {}
+        struct MemoryData {
+
+            struct MemoryBlock {
+
+                explicit MemoryBlock(VkDeviceSize size) : _size(size) {}
 
-                    friend bool operator<(const Block& lhs, const Block& rhs) {
-                        return lhs._offset < rhs._offset;
-                    }
+                VkDeviceMemory _vMemory = VK_NULL_HANDLE;
+                VkDeviceSize _size = 0;
 
-                    VkDeviceSize _offset = 0;
-                    mutable VkDeviceSize _size = 0;
-                };
+                // holds a single resource and isn't known to the tlsf
+                bool _dedicated = false;
 
-                std::set<Block> _blocks;
+                // for the block's whole life, null unless host visible
+                void* _mapped = nullptr;
             };
 
             MemoryData(uint32_t memoryType) : _memoryType(memoryType) {}
 
-            bool Allocate(const VkMemoryRequirements& memRequirements, AllocationData& data);
-            decltype(std::multiset<LogicalBlock>{}.begin()) CreateMemoryBlock(uint32_t memoryType);
+            // without `mayGrow` only existing blocks are used
+            bool Allocate(const VkMemoryRequirements& memRequirements, AllocationData& data, bool mayGrow = true);
+            bool AllocateDedicated(const VkMemoryRequirements& memRequirements, const VkMemoryDedicatedAllocateInfo& dedicatedInfo, AllocationData& data);
+            void Free(const AllocationData& data);
+
+            // big enough for `minSize` at least
+            bool CreateMemoryBlock(VkDeviceSize minSize);
+            // the region has to be completely free
+            void ReleaseMemoryBlock(uint32_t region);
+
+            // releases blocks which have been empty for config.emptyBlockFrames
+            void ReleaseEmptyBlocks(uint64_t frame);
+            uint32_t EmplaceMemoryBlock(VkDeviceMemory vMemory, VkDeviceSize size, bool dedicated);
 
             uint32_t _memoryType;
 
-            std::multiset<LogicalBlock> _logicalBlocks;
+            // every shared memory block is a region of its own
+            static constexpr uint32_t NoBlock = std::numeric_limits<uint32_t>::max();
+
+            static constexpr uint64_t NotEmpty = std::numeric_limits<uint64_t>::max();
+
+            Tlsf _tlsf;
+            // NoBlock for removed regions
+            std::vector<uint32_t> _blockByRegion;
+            // frame since which the region has nothing allocated, NotEmpty otherwise
+            std::vector<uint64_t> _emptySince;
+
+            VkDeviceSize _nextBlockSize = 0;
 
             std::vector<MemoryBlock> _memoryBlocks;
+            // slots of freed blocks
+            std::vector<uint32_t> _unusedBlocks;
         };
 
         static std::unordered_map<uint32_t, MemoryData> _memoryByType;
@@ -163,65 +391,157 @@ namespace Rise {
         static std::unordered_map<VkBuffer, AllocationData> _bufferAllocations;
         static std::unordered_map<VkImage, AllocationData> _imageAllocations;
 
+        static std::unordered_map<VkBuffer, Relocation<BufferMoved>> _bufferRelocations;
+        static std::unordered_map<VkImage, Relocation<ImageMoved>> _imageRelocations;
+
+        // old handles whose replacement has been handed over, until the old one is released
+        static std::unordered_map<VkBuffer, VkBuffer> _bufferMoves;
+        static std::unordered_map<VkImage, VkImage> _imageMoves;
+
+        static Config _config;
+
+        static Drain _drain;
+        static uint64_t _nextDrainSearch;
+
+        static std::vector<Retired> _retired;
+
+        // indexed by heap
+        static std::vector<HeapBudget> _budgets;
+        static std::vector<uint64_t> _nextPressureFrame;
+
+        static std::unordered_map<uint32_t, PressureCallback> _pressureCallbacks;
+        static uint32_t _nextPressureCallbackId;
+
         static std::shared_mutex _allocationLock;
     };
 
+    // Linear allocator over persistently mapped host visible buffers.
+    // Everything allocated since the last Reset() has to stay untouched by the gpu,
+    // so the owner resets it only after the work that used the memory has finished,
+    // e.g. per frame in flight, after its fence has been signaled.
     class GpuStackAllocator {
     public:
 
-        class Buffer {
-            Buffer() = default;
-
-            void MapMemory(void** ppData) const;
-            void UnmapMemory() const;
+        struct Allocation {
+            VkBuffer vBuffer = VK_NULL_HANDLE;
+            VkDeviceSize offset = 0;
+            VkDeviceSize size = 0;
+            void* data = nullptr;
 
-            VkBuffer vBuffer() const {
-                return _vBuffer;
+            explicit operator bool() const {
+                return vBuffer != VK_NULL_HANDLE;
             }
+        };
 
-        private:
-            friend GpuStackAllocator;
-            Buffer(VkBuffer vBuffer) : _vBuffer(vBuffer) {}
+        explicit GpuStackAllocator(VkBufferUsageFlags usage, VkDeviceSize chunkSize = RISE_GPU_STACK_ALLOCATOR_CHUNK_SIZE);
+        ~GpuStackAllocator();
 
-            VkBuffer _vBuffer = nullptr;
-        };
+        GpuStackAllocator(const GpuStackAllocator&) = delete;
+        GpuStackAllocator& operator=(const GpuStackAllocator&) = delete;
 
-        Buffer CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkMemoryPropertyFlags ignoreProperties = 0);
+        Allocation Allocate(VkDeviceSize size, VkDeviceSize alignment);
 
         void Reset();
 
     private:
 
-        struct AllocationData {
-            VkDeviceSize offset = 0;
+        struct Chunk {
+            GpuAllocator::Buffer buffer;
+            VkDeviceSize size = 0;
+            uint8_t* data = nullptr;
         };
 
-        bool Allocate(const VkMemoryRequirements& memRequirements, VkMemoryPropertyFlags properties, VkMemoryPropertyFlags ignoreProperties, VkDeviceMemory& memory, AllocationData& data);
+        bool TryAllocate(Chunk& chunk, VkDeviceSize offset, VkDeviceSize size, VkDeviceSize alignment, Allocation& allocation);
+        Chunk* CreateChunk(VkDeviceSize size);
 
-        struct MemoryData {
+        const VkBufferUsageFlags _usage;
+        const VkDeviceSize _chunkSize;
 
-            struct MemoryBlock {
-                explicit MemoryBlock(VkDeviceSize size) : _size(size) {}
+        std::vector<Chunk> _chunks;
+        size_t _chunkIndex = 0;
+        VkDeviceSize _offset = 0;
+    };
 
-                VkDeviceSize freeSpace() const {
-                    return _size - _usedSize;
-                }
+    // Images living only for a part of a frame, e.g. intermediate targets of multi pass effects.
+    // Lifetimes are declared as ranges of pass indices, images whose ranges don't overlap share memory,
+    // so the content of an image is undefined at its first use: passes have to start from
+    // VK_IMAGE_LAYOUT_UNDEFINED, and the previous user of the memory must be done with it,
+    // which passes recorded one after another with the usual external dependencies are.
+    // Images used only as attachments get VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT
+    // and lazily allocated memory where the device has it.
+    class GpuAliasAllocator {
+    public:
 
-                VkDeviceMemory _vMemory;
-                VkDeviceSize _size = 0;
-                VkDeviceSize _usedSize = 0;
-            };
+        using Id = uint32_t;
 
-            MemoryData() = default;
+        GpuAliasAllocator() = default;
+        ~GpuAliasAllocator();
 
-            bool Allocate(uint32_t memoryType, const VkMemoryRequirements& memRequirements, AllocationData& data);
-            void CreateMemoryBlock(uint32_t memoryType);
+        GpuAliasAllocator(const GpuAliasAllocator&) = delete;
+        GpuAliasAllocator& operator=(const GpuAliasAllocator&) = delete;
 
-            std::vector<MemoryBlock> _memoryBlocks;
+        // the image is used by passes [firstPass, lastPass] of the frame
+        Id Declare(const VkExtent3D& extent, VkFormat format, VkImageUsageFlags usage, uint32_t firstPass, uint32_t lastPass);
+
+        // Creates the declared images, unless they are the same as the last time.
+        // Replaced images stay alive for frames in flight, but views of them have to be
+        // recreated. Returns whether the images were replaced.
+        bool Build();
+
+        // empty when the last Build() failed
+        GpuAllocator::Image image(Id id) const {
+            return id < _images.size() ? GpuAllocator::Image(_images[id].vImage) : GpuAllocator::Image();
+        }
+
+        // starts the declarations of the next frame
+        void Reset() {
+            _declarations.clear();
+        }
+
+        // device memory taken by the images, and what they'd take without aliasing
+        VkDeviceSize memorySize() const;
+        VkDeviceSize unaliasedSize() const;
+
+    private:
+
+        struct Declaration {
+            VkExtent3D extent{};
+            VkFormat format = VK_FORMAT_UNDEFINED;
+            VkImageUsageFlags usage = 0;
+            uint32_t firstPass = 0;
+            uint32_t lastPass = 0;
+
+            bool Overlaps(const Declaration& other) const {
+                return firstPass <= other.lastPass && other.firstPass <= lastPass;
+            }
+
+            bool operator==(const Declaration& other) const;
         };
 
-        std::unordered_map<uint32_t, MemoryData> _memoryByType;
+        struct AliasedImage {
+            VkImage vImage = VK_NULL_HANDLE;
+            VkMemoryRequirements requirements{};
+            uint32_t memoryType = 0;
+            VkDeviceSize offset = 0;
+        };
+
+        struct Memory {
+            uint32_t memoryType = 0;
+            VkDeviceMemory vMemory = VK_NULL_HANDLE;
+            VkDeviceSize size = 0;
+        };
+
+        bool CreateImage(const Declaration& declaration, AliasedImage& image);
+        // offsets of the images of one memory type, returns the memory size they need
+        VkDeviceSize Place(uint32_t memoryType);
+        void Release();
+
+        std::vector<Declaration> _declarations;
 
+        // of the last Build()
+        std::vector<Declaration> _builtDeclarations;
+        std::vector<AliasedImage> _images;
+        std::vector<Memory> _memories;
     };
 
 }
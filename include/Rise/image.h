@@ -6,6 +6,7 @@
 #include "resource.h"
 #include "framebuffer.h"
 #include "gpu_allocator.h"
+#include "upload_queue.h"
 
 #include <vulkan/vulkan_core.h>
 
@@ -69,6 +70,8 @@ namespace Rise {
         }
 
         void Load(VkImage vImage, VkImageAspectFlags aspectFlags, bool singleByte = false);
+        // switches to a copy of the image made by the defragmenter
+        void Relocate(VkImage vImage);
 
         void Unload() override;
 
@@ -76,8 +79,12 @@ namespace Rise {
 
 	private:
 
+        VkImageView CreateImageView();
+
         const Meta* _meta = nullptr;
         VkImage _vImage = nullptr;
+        VkImageAspectFlags _aspectFlags = 0;
+        bool _singleByte = false;
 
         VkImageView _vImageView = nullptr;
         std::unordered_map<const RenderPass*, Framebuffer> _framebuffers;
@@ -100,15 +107,19 @@ namespace Rise {
             SetupMeta(*meta);
         };
         ~Image() override {
+            Instance()->Uploads().Wait(_upload);
             if (IsLoaded()) {
                 Unload();
             }
         }
 
-        void LoadFromFile(const std::string& filename);
+        // stops early and stays unloaded once `token` is cancelled
+        void LoadFromFile(const std::string& filename, const CancellationToken& token = {});
         void Unload() override;
 
         GpuAllocator::Image _image;
+        UploadQueue::Ticket _upload = 0;
+        std::shared_ptr<GpuAllocator::RelocationGuard> _relocation;
     };
 
     class SwapchainImage : public IImage {
@@ -138,11 +149,15 @@ namespace Rise {
         }
 
         void Load();
+        // Uses an image of the alias allocator, which keeps owning it.
+        // Has to be loaded again whenever the allocator's Build() replaces its images.
+        void Load(const GpuAliasAllocator& aliases, GpuAliasAllocator::Id id);
         void Unload() override;
 
     private:
 
         GpuAllocator::Image _image;
+        bool _aliased = false;
 
     };
 
@@ -162,17 +177,22 @@ namespace Rise {
             SetupMeta(*meta);
         };
         ~CustomImage() override {
+            Instance()->Uploads().Wait(_upload);
             if (IsLoaded()) {
                 Unload();
             }
         }
 
+        // null when there is no staging buffer, the image is failed then
         GpuAllocator::Buffer::MapPtr LoadPrepare(uint32_t pixelSize);
-        void LoadCommit(uint32_t pixelSize);
+        // false when the image failed
+        bool LoadCommit(uint32_t pixelSize);
         void Unload() override;
 
         GpuAllocator::Buffer _stagingBuffer;
         GpuAllocator::Image _image;
+        UploadQueue::Ticket _upload = 0;
+        std::shared_ptr<GpuAllocator::RelocationGuard> _relocation;
     };
 
     class N9Slice : public ResourceBase, public RiseObject {
@@ -193,10 +213,7 @@ namespace Rise {
             }
         };
 
-        N9Slice(Core* core, const Meta* meta)
-            : RiseObject(core) {
-            SetupMeta(*meta);
-        }
+        N9Slice(Core* core, const Meta* meta);
         virtual ~N9Slice() {
             if (IsLoaded()) {
                 Unload();
@@ -215,6 +232,8 @@ namespace Rise {
             return _image;
         }
 
+        // the texture
+        std::vector<JobHandle> Dependencies();
         void Load();
 
         void Unload() override {
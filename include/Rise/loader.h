@@ -2,36 +2,251 @@
 #ifndef rise_loader_h
 #define rise_loader_h
 
-#include <queue>
-#include <thread>
-#include <mutex>
+#include "allocator.h"
+#include "work_stealing_deque.h"
+
+#include <array>
+#include <atomic>
 #include <condition_variable>
+#include <cstddef>
+#include <deque>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_set>
+#include <vector>
+
+// bytes a job's callable may take before it's moved to the heap
+#ifndef RISE_LOADER_JOB_STORAGE
+#define RISE_LOADER_JOB_STORAGE 64
+#endif //RISE_LOADER_JOB_STORAGE
+
+// most jobs a worker moves from the shared queue to its deque at once
+#ifndef RISE_LOADER_INJECTED_BATCH
+#define RISE_LOADER_INJECTED_BATCH 32
+#endif //RISE_LOADER_INJECTED_BATCH
+
+// rounds of stealing attempts before an idle worker goes to sleep
+#ifndef RISE_LOADER_SPIN_COUNT
+#define RISE_LOADER_SPIN_COUNT 64
+#endif //RISE_LOADER_SPIN_COUNT
 
 namespace Rise {
-    
+
+    // Workers always take the most urgent job they can find, jobs of one priority
+    // aren't ordered against each other.
+    enum class JobPriority : uint8_t {
+        // needed by the current frame
+        Immediate,
+        // needed by what's about to be shown
+        Visible,
+        // likely needed soon
+        Prefetch,
+        Background,
+    };
+
+    constexpr uint32_t JobPriorityCount = 4;
+
+    // Completion of a job, or of anything else that jobs may wait for,
+    // e.g. a resource whose data still has to reach the gpu.
+    // An empty handle counts as complete.
+    class JobHandle {
+    public:
+
+        JobHandle() = default;
+
+        // completed by Complete() rather than by a job
+        static JobHandle Pending();
+
+        // runs the continuations of the waiting jobs, only the first call counts
+        void Complete() const;
+
+        bool IsComplete() const;
+
+        explicit operator bool() const {
+            return _state != nullptr;
+        }
+
+    private:
+
+        friend class Loader;
+
+        struct State {
+            std::mutex lock;
+            bool complete = false;
+            std::vector<std::function<void()>> continuations;
+        };
+
+        // calls `continuation` right away when already complete
+        void Then(std::function<void()> continuation) const;
+
+        std::shared_ptr<State> _state;
+    };
+
+    // Job system with work stealing deques per worker, one for every priority.
+    // Jobs added from a worker go to its own deque without any locking, jobs added
+    // by other threads go through shared queues. Idle workers steal the oldest
+    // jobs of the others. A higher priority is searched everywhere before a lower
+    // one. Jobs are kept in pooled blocks with inline storage for their callable,
+    // so adding one doesn't allocate in the common case.
     class Loader {
     public:
 
-        Loader(uint32_t threadCount);
+        struct Config {
+            // 0 sizes the pool from the hardware threads
+            uint32_t threadCount = 0;
+            // hardware threads left to the main and render threads by the automatic sizing
+            uint32_t reservedThreads = 2;
+
+            // Pins worker i to hardware thread (reservedThreads + i) modulo their count.
+            // Mostly useful for profiling, the os usually balances better on its own.
+            bool pinThreads = false;
+
+            // workers are named "<threadName> <index>" for debuggers and profilers, empty leaves them be
+            std::string threadName = "Rise Loader";
+        };
+
+        // the config of loaders created from now on, Core creates its own in Init()
+        static void SetConfig(const Config& config);
+        static Config config();
+
+        // hardware threads minus the reserved ones, at least one
+        static uint32_t AutoThreadCount(uint32_t reservedThreads);
+
+        explicit Loader(const Config& config);
+        explicit Loader(uint32_t threadCount);
         ~Loader();
 
+        Loader(const Loader&) = delete;
+        Loader& operator=(const Loader&) = delete;
+
+        // safe to call from inside a job
+        template <class T>
+        void AddJob(T&& job, JobPriority priority = JobPriority::Visible) {
+            auto* pJob = new(_jobPool.allocate()) Job(std::forward<T>(job));
+            pJob->_priority = priority;
+            Push(pJob);
+        }
+
+        // The job is queued only once all of the dependencies are complete, until then
+        // it takes no worker. Jobs whose dependencies never complete are never run,
+        // the loader frees them when it's destroyed.
         template <class T>
-        void AddJob(T&& job) {
-            std::unique_lock<std::mutex> ul(_queueLock);
-            _workQueue.emplace(std::forward<T>(job));
-            _queueCond.notify_one();
+        JobHandle AddJob(T&& job, const std::vector<JobHandle>& dependencies, JobPriority priority = JobPriority::Visible) {
+            auto* pJob = new(_jobPool.allocate()) Job(std::forward<T>(job));
+            pJob->_priority = priority;
+            pJob->_handle._state = std::make_shared<JobHandle::State>();
+            auto handle = pJob->_handle;
+            AddDependencies(pJob, dependencies);
+            return handle;
+        }
+
+        // whether the calling thread is one of this loader's workers
+        bool IsWorkerThread() const;
+
+        uint32_t threadCount() const {
+            return static_cast<uint32_t>(_workers.size());
         }
 
     private:
 
-        void ThreadLoop();
+        class Job {
+        public:
+
+            template <class F>
+            explicit Job(F&& f) {
+                using Fn = std::decay_t<F>;
+                if constexpr (sizeof(Fn) <= sizeof(_storage) && alignof(Fn) <= alignof(std::max_align_t)) {
+                    new(_storage) Fn(std::forward<F>(f));
+                    _invoke = [](void* storage) { (*std::launder(reinterpret_cast<Fn*>(storage)))(); };
+                    _destroy = [](void* storage) { std::launder(reinterpret_cast<Fn*>(storage))->~Fn(); };
+                }
+                else {
+                    new(_storage) Fn*(new Fn(std::forward<F>(f)));
+                    _invoke = [](void* storage) { (**reinterpret_cast<Fn**>(storage))(); };
+                    _destroy = [](void* storage) { delete *reinterpret_cast<Fn**>(storage); };
+                }
+            }
+            ~Job() {
+                _destroy(_storage);
+            }
+
+            Job(const Job&) = delete;
+            Job& operator=(const Job&) = delete;
+
+            void operator()() {
+                _invoke(_storage);
+            }
+
+            // only set for jobs with dependencies
+            JobHandle _handle;
+            // incomplete dependencies, and one more while they're being registered
+            std::atomic<uint32_t> _blockers = 1;
+            JobPriority _priority = JobPriority::Visible;
+
+        private:
+
+            alignas(std::max_align_t) std::byte _storage[RISE_LOADER_JOB_STORAGE];
+            void (*_invoke)(void*);
+            void (*_destroy)(void*);
+        };
+
+        struct Worker {
+            std::array<WorkStealingDeque<Job*>, JobPriorityCount> deques;
+            std::thread thread;
+            // state of the victim picking xorshift
+            uint32_t random = 0;
+        };
+
+        // jobs waiting for their dependencies, shared with the continuations that unblock them
+        struct Blocked {
+            std::mutex lock;
+            // null once the loader is gone
+            Loader* loader = nullptr;
+            std::unordered_set<Job*> jobs;
+        };
+
+        void AddDependencies(Job* job, const std::vector<JobHandle>& dependencies);
+        // with the blocked lock held
+        void Unblock(Job* job);
+
+        void Push(Job* job);
+        Job* Find(uint32_t workerIndex);
+        Job* TakeInjected(uint32_t workerIndex, uint32_t priority);
+        Job* Steal(uint32_t workerIndex, uint32_t priority);
+        void Run(Job* job);
+
+        void ThreadLoop(uint32_t workerIndex);
+        // names and pins the calling worker
+        void SetupThread(uint32_t workerIndex);
+
+        static std::mutex _configLock;
+        static Config _config;
+
+        Config _instanceConfig;
+
+        Allocator _jobPool;
+
+        std::vector<std::unique_ptr<Worker>> _workers;
+
+        std::shared_ptr<Blocked> _blocked = std::make_shared<Blocked>();
+
+        // jobs added by threads which aren't workers, by priority
+        std::mutex _injectedLock;
+        std::array<std::deque<Job*>, JobPriorityCount> _injected;
+        std::array<std::atomic<uint32_t>, JobPriorityCount> _injectedCount = {};
+
+        // added, but not yet taken by a worker
+        std::atomic<uint32_t> _pending = 0;
 
-        std::queue<std::function<void()>> _workQueue;
-        std::mutex _queueLock;
-        std::condition_variable _queueCond;
-        std::vector<std::thread> _jobThreads;
-        bool _destroying = false;
+        std::mutex _sleepLock;
+        std::condition_variable _wakeCond;
+        std::atomic<uint32_t> _sleeping = 0;
+        std::atomic<bool> _destroying = false;
 
     };
 
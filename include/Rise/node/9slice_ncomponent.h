@@ -5,6 +5,7 @@
 #include "Rise/node/node.h"
 
 #include "Rise/image.h"
+#include "Rise/task.h"
 
 namespace Rise {
 
@@ -15,6 +16,7 @@ namespace Rise {
         ~N9SliceNComponent() override;
 
         void setTexture(std::shared_ptr<N9Slice> texture) {
+            _textureLoad.Cancel();
             _texture = texture;
         }
 
@@ -27,8 +29,12 @@ namespace Rise {
 
         void draw(Draw::Context context) override;
 
+        Task LoadTexture(std::string id);
+
         float _scale = 1.f;
+        // set once loaded along with its image
         std::shared_ptr<N9Slice> _texture;
+        Task _textureLoad;
     };
 
 }
@@ -5,6 +5,7 @@
 #include "Rise/node/node.h"
 
 #include "Rise/font.h"
+#include "Rise/task.h"
 
 namespace Rise {
 
@@ -19,6 +20,7 @@ namespace Rise {
         }
 
         void SetFont(std::shared_ptr<Font> font) {
+            _fontLoad.Cancel();
             _font = std::move(font);
         }
 
@@ -31,9 +33,13 @@ namespace Rise {
 
         void draw(Draw::Context context) override;
 
+        Task LoadFont(std::string id);
+
         uint32_t _size = 32u;
         std::string _text;
+        // set once loaded
         std::shared_ptr<Font> _font;
+        Task _fontLoad;
     };
 
 }
@@ -50,13 +50,17 @@ namespace Rise {
         struct SetLayout {
             std::unordered_map<VkDescriptorType, uint32_t> _types;
             VkDescriptorSetLayout _vDescriptorSetLayout;
+
+            bool DynamicUniformsOnly() const {
+                return _types.size() == 1 && _types.begin()->first == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+            }
         };
 
         const SetLayout& getSetLayout(uint16_t set) const;
 
         void BindPipeline(VkCommandBuffer commandBuffer, const VkExtent2D& vExtent);
 
-        void BindDescriptorSet(VkCommandBuffer commandBuffer, Uniform& uniform);
+        void BindDescriptorSet(VkCommandBuffer commandBuffer, uint32_t set, const Uniform& uniform);
         void PushConstant(VkCommandBuffer commandBuffer, VkShaderStageFlags stageFlags, uint32_t offset, const std::vector<uint8_t>& data);
 
         const Meta* meta() {
@@ -67,6 +71,8 @@ namespace Rise {
             return _renderPass;
         }
 
+        // the render pass and both shaders
+        std::vector<JobHandle> Dependencies();
         void Load();
 
     protected:
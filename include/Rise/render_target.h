@@ -97,7 +97,7 @@ namespace Rise {
             }
 
             Draw::Context context(*this, commandBuffer, image);
-            _imageDatas[_imageDataIndex].uniforms.emplace_back();
+            _imageDatas[_imageDataIndex].NextUniforms();
 
             drawImpl(context);
 
@@ -138,14 +138,19 @@ namespace Rise {
 
         struct SingleImageData : public RiseObject {
             explicit SingleImageData(Core* core)
-                : RiseObject(core) {}
+                : RiseObject(core), frameStack(std::make_unique<StackAllocator>()) {}
 
             void Load() {
                 CreateCommandBuffer();
                 SyncObjects();
+                uploadStack = std::make_unique<GpuStackAllocator>(
+                    VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
             }
 
             void Unload() {
+                uniforms.clear();
+                uploadStack.reset();
+
                 vkDestroySemaphore(Instance()->_vDevice, vRenderFinishedSemaphore, nullptr);
                 vkDestroyFence(Instance()->_vDevice, vInFlightFence, nullptr);
 
@@ -228,6 +233,7 @@ namespace Rise {
             }
 
             void CleanDescriptorPools() {
+                sharedUniformSets.clear();
                 for (auto& pools : descriptorPoolDatas) {
                     for (auto& poolData : pools.second) {
                         poolData.count = 0;
@@ -236,11 +242,36 @@ namespace Rise {
                 }
             }
 
+            using Uniforms = std::unordered_map<uint16_t, Uniform, std::hash<uint16_t>, std::equal_to<uint16_t>,
+                StackStlAllocator<std::pair<const uint16_t, Uniform>>>;
+
+            Uniforms& NextUniforms() {
+                return uniforms.emplace_back(Uniforms::allocator_type(*frameStack));
+            }
+
+            // everything from here is dropped at once, when the frame's fence has been signaled
+            void ResetFrameData() {
+                uniforms.clear();
+                frameStack->Reset();
+                uploadStack->Reset();
+            }
+
+            template <class Setter, class... Args>
+            std::shared_ptr<Setter> MakeSetter(Args&&... args) {
+                return std::allocate_shared<Setter>(StackStlAllocator<Setter>(*frameStack), std::forward<Args>(args)...);
+            }
+
             VkSemaphore vRenderFinishedSemaphore;
             VkFence vInFlightFence;
 
-            std::vector<std::unordered_map<uint16_t, Uniform>> uniforms;
+            // per draw structures live in the frame stack, it must outlive them
+            std::unique_ptr<StackAllocator> frameStack;
+            // gpu visible per frame data: uniforms, streamed vertices, staging
+            std::unique_ptr<GpuStackAllocator> uploadStack;
+            std::vector<Uniforms> uniforms;
             std::unordered_map<PoolKey, std::vector<DescriptorPoolData>> descriptorPoolDatas;
+            // sets of dynamic uniform buffers only, one per layout and buffer for the whole frame
+            std::unordered_map<CombinedKey<VkDescriptorSetLayout, VkBuffer>, VkDescriptorSet> sharedUniformSets;
 
             // TODO remake commandBuffer through acquiring directly from pool to reusing
             VkCommandBuffer vCommandBuffer;
@@ -270,7 +301,7 @@ namespace Rise {
 
             vkWaitForFences(Instance()->_vDevice, 1, &imageData.vInFlightFence, VK_TRUE, UINT64_MAX);
 
-            imageData.uniforms.clear();
+            imageData.ResetFrameData();
 
             imageData.CleanDescriptorPools();
 
@@ -305,7 +336,7 @@ namespace Rise {
         }
 
         void Sampler(uint16_t set, uint16_t binding, std::shared_ptr<Sampler> sampler) {
-            if (!_renderer.HasFreshValue() || !_renderer.FreshValue() || !_renderer.FreshValue()->IsLoaded()) {
+            if (!_renderer.HasFreshValue() || !_renderer.FreshValue() || !_renderer.FreshValue()->Touch()) {
                 return;
             }
 
@@ -315,16 +346,16 @@ namespace Rise {
             auto& currentUniforms = imageData.uniforms.back();
 
             auto& uniform = currentUniforms.try_emplace(set,
-                Instance(), imageData.GetDescriptorPoolData(setLayout._types), setLayout).first->second;
+                Instance(), *imageData.frameStack, imageData.GetDescriptorPoolData(setLayout._types), setLayout).first->second;
 
             auto& uniformData = uniform.setters.try_emplace(binding,
-                std::make_shared<SamplerUniformSetter>(
+                imageData.MakeSetter<SamplerUniformSetter>(
                     uniform.vDescriptorSet, binding, sampler)
             ).first->second;
         }
 
         void SampledTexture(uint16_t set, uint16_t binding, std::shared_ptr<Rise::Sampler> sampler, std::shared_ptr<IImage> image) {
-            if (!_renderer.HasFreshValue() || !_renderer.FreshValue() || !_renderer.FreshValue()->IsLoaded()) {
+            if (!_renderer.HasFreshValue() || !_renderer.FreshValue() || !_renderer.FreshValue()->Touch()) {
                 return;
             }
 
@@ -334,16 +365,16 @@ namespace Rise {
             auto& currentUniforms = imageData.uniforms.back();
 
             auto& uniform = currentUniforms.try_emplace(set,
-                Instance(), imageData.GetDescriptorPoolData(setLayout._types), setLayout).first->second;
+                Instance(), *imageData.frameStack, imageData.GetDescriptorPoolData(setLayout._types), setLayout).first->second;
 
             auto& uniformData = uniform.setters.try_emplace(binding,
-                std::make_shared<ImageUniformSetter>(
+                imageData.MakeSetter<ImageUniformSetter>(
                     uniform.vDescriptorSet, binding, image, sampler)
             ).first->second;
         }
 
         void Textures(uint16_t set, uint16_t binding, const std::vector<std::shared_ptr<IImage>>& images) {
-            if (!_renderer.HasFreshValue() || !_renderer.FreshValue() || !_renderer.FreshValue()->IsLoaded()) {
+            if (!_renderer.HasFreshValue() || !_renderer.FreshValue() || !_renderer.FreshValue()->Touch()) {
                 return;
             }
 
@@ -353,17 +384,17 @@ namespace Rise {
             auto& currentUniforms = imageData.uniforms.back();
 
             auto& uniform = currentUniforms.try_emplace(set,
-                Instance(), imageData.GetDescriptorPoolData(setLayout._types), setLayout).first->second;
+                Instance(), *imageData.frameStack, imageData.GetDescriptorPoolData(setLayout._types), setLayout).first->second;
 
             auto& uniformData = uniform.setters.try_emplace(binding,
-                std::make_shared<ImagesUniformSetter>(
+                imageData.MakeSetter<ImagesUniformSetter>(
                     uniform.vDescriptorSet, binding, images)
             ).first->second;
         }
 
         template <class T>
         void Uniform(uint16_t set, uint16_t binding, const std::string& id, const T& value) {
-            if (!_renderer.HasFreshValue() || !_renderer.FreshValue() || !_renderer.FreshValue()->IsLoaded()) {
+            if (!_renderer.HasFreshValue() || !_renderer.FreshValue() || !_renderer.FreshValue()->Touch()) {
                 return;
             }
 
@@ -426,7 +457,7 @@ namespace Rise {
                     renderPassValue.ready();
                 }
 
-                if (!renderer->IsLoaded()) {
+                if (!renderer->Touch()) {
                     return;
                 }
 
@@ -438,14 +469,14 @@ namespace Rise {
                 value.ready();
             }
 
-            if (!_renderer.HasValue() || !_renderer.Value()->IsLoaded()) {
+            if (!_renderer.HasValue() || !_renderer.Value()->Touch()) {
                 return;
             }
 
             if (_renderer.Value()->meta()->_verticesFormat.SizeOf() > 0) {
                 if (auto value = _vertices.CheckValue()) {
                     auto vertices = *value;
-                    if (vertices && vertices->meta().format() == _renderer.Value()->meta()->_verticesFormat && vertices->IsLoaded()) {
+                    if (vertices && vertices->meta().format() == _renderer.Value()->meta()->_verticesFormat && vertices->Touch()) {
 
                         VkBuffer vertexBuffers[] = { vertices->buffer().vBuffer() };
                         VkDeviceSize offsets[] = { 0 };
@@ -514,26 +545,91 @@ namespace Rise {
 
                 auto& setLayout = renderer->getSetLayout(set);
 
+                if (setLayout.DynamicUniformsOnly()) {
+                    // the draw can't go without the set bound
+                    if (currentUniforms.find(set) == currentUniforms.end()
+                        && !EmplaceSharedUniform(imageData, currentUniforms, set, setLayout)) {
+                        return;
+                    }
+                    continue;
+                }
+
                 auto& uniform = currentUniforms.try_emplace(set,
-                    Instance(), imageData.GetDescriptorPoolData(setLayout._types), setLayout).first->second;
+                    Instance(), *imageData.frameStack, imageData.GetDescriptorPoolData(setLayout._types), setLayout).first->second;
 
                 uniform.setters.try_emplace(binding,
-                    std::make_shared<BufferUniformSetter>(
-                        uniform.vDescriptorSet, binding, data));
+                    imageData.MakeSetter<BufferUniformSetter>(
+                        uniform.vDescriptorSet, binding, data, *imageData.uploadStack));
             }
 
             for (auto& uniformPair : imageData.uniforms.back()) {
                 if (!uniformPair.second.Ready()) {
                     return;
                 }
-                _renderer.Value()->BindDescriptorSet(imageData.vCommandBuffer, uniformPair.second);
+                _renderer.Value()->BindDescriptorSet(imageData.vCommandBuffer, uniformPair.first, uniformPair.second);
             }
 
             vkCmdDraw(imageData.vCommandBuffer, count, 1, 0, 0);
 
             if (!imageData.uniforms.back().empty()) {
-                imageData.uniforms.emplace_back();
+                imageData.NextUniforms();
+            }
+        }
+
+        // Sets made of uniform buffers only are shared by all draws of the frame,
+        // draws differ in dynamic offsets only. False when there is no memory for the set.
+        bool EmplaceSharedUniform(SingleImageData& imageData, SingleImageData::Uniforms& currentUniforms, uint16_t set, const Renderer::SetLayout& setLayout) {
+            auto alignment = Instance()->_vPhysicalDeviceProperties.limits.minUniformBufferOffsetAlignment;
+            auto alignUp = [alignment](VkDeviceSize size) {
+                return (size + alignment - 1) & ~(alignment - 1);
+            };
+
+            // one allocation for the whole set, so that all of its bindings are in the same buffer
+            VkDeviceSize setSize = 0;
+            for (auto& [key, data] : _uniformDatas) {
+                if (key.Get<0>() == set) {
+                    setSize += alignUp(data.size());
+                }
+            }
+
+            auto allocation = imageData.uploadStack->Allocate(setSize, alignment);
+            if (!allocation) {
+                Error("failed to allocate uniform buffer!");
+                return false;
             }
+
+            auto [itSet, emplaced] = imageData.sharedUniformSets.try_emplace({ setLayout._vDescriptorSetLayout, allocation.vBuffer });
+            if (emplaced) {
+                Rise::Uniform sharedUniform(Instance(), *imageData.frameStack, imageData.GetDescriptorPoolData(setLayout._types), setLayout);
+                itSet->second = sharedUniform.vDescriptorSet;
+
+                for (auto& [key, data] : _uniformDatas) {
+                    if (key.Get<0>() == set) {
+                        BufferUniformSetter::WriteDescriptor(itSet->second, key.Get<1>(), allocation.vBuffer, data.size());
+                    }
+                }
+            }
+
+            auto& uniform = currentUniforms.try_emplace(set, Instance(), *imageData.frameStack, itSet->second).first->second;
+
+            VkDeviceSize offset = 0;
+            for (auto& [key, data] : _uniformDatas) {
+                if (key.Get<0>() != set) {
+                    continue;
+                }
+
+                auto slice = allocation;
+                slice.offset += offset;
+                slice.size = data.size();
+                slice.data = reinterpret_cast<uint8_t*>(allocation.data) + offset;
+                memcpy(slice.data, data.data(), data.size());
+
+                uniform.setters.try_emplace(key.Get<1>(), imageData.MakeSetter<BufferUniformSetter>(slice));
+
+                offset += alignUp(data.size());
+            }
+
+            return true;
         }
 
         void ResetDrawResources() {
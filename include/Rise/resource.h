@@ -10,17 +10,30 @@
 #include <vulkan/vulkan.h>
 #include "pugixml.hpp"
 
+#include <atomic>
+#include <chrono>
 #include <fstream>
+#include <functional>
 #include <unordered_map>
 #include <mutex>
 #include <shared_mutex>
 #include <unordered_set>
+#include <vector>
 
 namespace Rise {
 
     class ResourceBase {
     public:
 
+        enum class LoadState : uint32_t {
+            // never loaded, unloaded, or its load was cancelled
+            Unloaded,
+            // queued or being loaded
+            Loading,
+            Loaded,
+            Failed,
+        };
+
         constexpr static bool MetaOnly = false;
         constexpr static bool InstantLoad = false;
 
@@ -37,27 +50,77 @@ namespace Rise {
             MarkUnloaded();
         }
 
-        bool IsLoaded() {
-            std::lock_guard<Spinlock> gl(_stateLock);
-            return _loaded;
+        // a single load, cheap enough to call per draw
+        LoadState loadState() const {
+            return _state.load(std::memory_order_acquire);
         }
 
-    protected:
-
-        void MarkLoaded() {
-            std::lock_guard<Spinlock> gl(_stateLock);
-            _loaded = true;
+        bool IsLoaded() const {
+            return loadState() == LoadState::Loaded;
         }
 
-        void MarkUnloaded() {
-            std::lock_guard<Spinlock> gl(_stateLock);
-            _loaded = false;
+        // IsLoaded() for draw code, the first touch of a queued resource moves its load
+        // to the front of the loader
+        bool Touch() {
+            auto state = loadState();
+            if (state == LoadState::Loading && !_boosted.exchange(true, std::memory_order_relaxed)) {
+                Boost();
+            }
+            return state == LoadState::Loaded;
         }
 
+        // Sleeps while the resource is loading, true once it's loaded.
+        // Don't wait from loader jobs for resources loaded by the same loader, use LoadedHandle().
+        bool WaitLoaded(std::chrono::milliseconds timeout = std::chrono::milliseconds::max());
+
+        // Called with whether the load succeeded once it's over, right away when it isn't loading.
+        // Callbacks run on the thread finishing the load, they should be short.
+        void OnLoaded(std::function<void(bool loaded)> callback);
+
+        // completes once the load is over, whether it succeeded or not,
+        // jobs depend on it instead of polling IsLoaded() and check it when they run
+        JobHandle LoadedHandle();
+
+    protected:
+
+        void MarkLoaded();
+        void MarkFailed();
+        void MarkUnloaded();
+        // a load that stopped on its CancellationToken, waiters are let go with the resource unloaded
+        void MarkCancelled();
+
     private:
 
-        Spinlock _stateLock;
-        bool _loaded = false;
+        friend class ResourceGenerator;
+        friend class CancellationToken;
+
+        void MarkLoading() {
+            std::lock_guard<std::mutex> lg(_lock);
+            _boosted.store(false, std::memory_order_relaxed);
+            _state.store(LoadState::Loading, std::memory_order_relaxed);
+            if (_loadedHandle.IsComplete()) {
+                _loadedHandle = JobHandle::Pending();
+            }
+        }
+
+        void Finish(LoadState state);
+        void Boost();
+
+        std::atomic<LoadState> _state = LoadState::Unloaded;
+        // threads in a timed WaitLoaded()
+        std::atomic<uint32_t> _timedWaiters = 0;
+        // the generator's load job holds a reference, see ResourceGenerator::IsUnused()
+        std::atomic<bool> _loadRunning = false;
+        std::atomic<bool> _boosted = false;
+        // held by one of the generator's vaults
+        std::atomic<bool> _cached = false;
+
+        // guards the callbacks, the handle and the boost, never taken to read the state
+        std::mutex _lock;
+        std::vector<std::function<void(bool)>> _callbacks;
+        JobHandle _loadedHandle = JobHandle::Pending();
+        // queues the load once more at the immediate priority, set by the generator
+        std::function<void()> _boost;
     };
 
 }
@@ -5,10 +5,11 @@
 #include "rise.h"
 #include "utils.h"
 #include "context.h"
-#include "allocator.h"
+#include "slab_allocator.h"
 #include "utils/data.h"
 
 #include "loader.h"
+#include "task.h"
 #include "pugixml.hpp"
 
 #include <unordered_map>
@@ -19,6 +20,7 @@
 #include <queue>
 #include <filesystem>
 #include <fstream>
+#include <memory>
 
 namespace Rise {
 
@@ -28,6 +30,24 @@ namespace Rise {
 #define RISE_RESOURCE_POOL_SIZE 4
 #endif
 
+    // Handed to a load run by the generator, tells it that only the loader and the
+    // generator's cache still hold the resource, so the rest of the work can be skipped.
+    // A default constructed token is never cancelled.
+    class CancellationToken {
+    public:
+
+        CancellationToken() = default;
+        explicit CancellationToken(std::weak_ptr<const ResourceBase> resource)
+            : _resource(std::move(resource)), _bound(true) {}
+
+        bool IsCancelled() const;
+
+    private:
+
+        std::weak_ptr<const ResourceBase> _resource;
+        bool _bound = false;
+    };
+
     template <class R>
     class ResourcePtr {
     public:
@@ -69,20 +89,28 @@ namespace Rise {
 
         template <class R, class... Args>
         std::shared_ptr<R> CreateRes(Args&&... args) {
-            auto&& sizeOf = static_cast<uint32_t>(sizeof(R));
-            auto& allocator = _allocators.try_emplace(sizeOf, sizeOf).first->second;
-            auto* res = reinterpret_cast<R*>(allocator.allocate());
+            static_assert(alignof(R) <= alignof(std::max_align_t), "Slab blocks are only aligned to max_align_t");
+            auto* res = reinterpret_cast<R*>(_allocator.allocate(sizeof(R)));
             new(res) R(Instance(), std::forward<Args>(args)...);
             return { res, std::bind(&ResourceManager::DestroyRes<R>, this, std::placeholders::_1) };
         }
 
+        std::vector<Allocator::Statistics> AllocatorStatistics() const {
+            return _allocator.statistics();
+        }
+
+        uint32_t TrimAllocators() {
+            return _allocator.Trim();
+        }
+        void SetAllocatorsAutoTrim(float lowWatermark) {
+            _allocator.SetAutoTrim(lowWatermark);
+        }
+
     private:
 
         template <class R>
         void DestroyRes(R* res) {
-            res->~R();
-            auto& allocator = _allocators.find(sizeof(R))->second;
-            allocator.deallocate(res);
+            _allocator.destroy(res);
         }
 
         friend class Renderer;
@@ -91,7 +119,7 @@ namespace Rise {
 
         std::mutex _unloadLock;
 
-        std::unordered_map<uint32_t, Allocator> _allocators;
+        SlabAllocator _allocator;
 
         bool _destroying = false;
     };
@@ -109,18 +137,26 @@ namespace Rise {
 
         void IndexResources();
 
+        // `priority` is the one of the load, should the resource need one
         template <class R>
-        std::shared_ptr<R> Get(const std::string& id) {
-            return ContsructById<R>(id, true);
+        std::shared_ptr<R> Get(const std::string& id, JobPriority priority = JobPriority::Visible) {
+            return ContsructById<R>(id, true, priority);
         }
 
         template <class R>
-        std::shared_ptr<R> Construct(const std::string& id) {
-            return ContsructById<R>(id, false);
+        std::shared_ptr<R> Construct(const std::string& id, JobPriority priority = JobPriority::Visible) {
+            return ContsructById<R>(id, false, priority);
+        }
+
+        // co_await GetAsync<Image>("texture") inside a Task suspends until the image is loaded,
+        // then continues on `resumeOn`. Has to be called from the main thread, like Get().
+        template <class R>
+        ResourceAwaiter<R> GetAsync(const std::string& id, ResumeOn resumeOn = ResumeOn::MainThread, JobPriority priority = JobPriority::Visible) {
+            return ResourceAwaiter<R>(Get<R>(id, priority), resumeOn);
         }
 
         template <class R, class K>
-        std::shared_ptr<R> GetByKey(const K& key) {
+        std::shared_ptr<R> GetByKey(const K& key, JobPriority priority = JobPriority::Visible) {
             auto [itVault, emplacedVault] = _resourcesByType.try_emplace(typeid(R));
             if (emplacedVault) {
                 itVault->second = new VaultByKey<R, K>();
@@ -131,15 +167,16 @@ namespace Rise {
             auto& resource = it->second;
             if (emplaced) {
                 resource = _manager.CreateRes<R>();
+                resource->_cached.store(true);
 
                 if constexpr (R::InstantLoad) {
                     resource->Load(key);
                 }
                 else {
-                    _loader.AddJob([resource, key]()
+                    ScheduleLoad(resource, [key](const std::shared_ptr<R>& resource, const CancellationToken&)
                         {
                             resource->Load(key);
-                        }
+                        }, {}, priority
                     );
                 }
             }
@@ -147,6 +184,16 @@ namespace Rise {
             return resource;
         }
 
+        // Drops cached resources nobody else holds, their memory goes once the last user
+        // lets them go. Returns the number of dropped resources.
+        uint32_t EvictUnused() {
+            uint32_t evicted = 0;
+            for (auto& vaultPair : _resourcesByType) {
+                evicted += vaultPair.second->EvictUnused();
+            }
+            return evicted;
+        }
+
         const static std::string metaExtension;
 
         template <class R>
@@ -158,7 +205,7 @@ namespace Rise {
     private:
 
         template <class R>
-        std::shared_ptr<R> ContsructById(const std::string& id, bool cached) {
+        std::shared_ptr<R> ContsructById(const std::string& id, bool cached, JobPriority priority) {
             auto [itVault, emplacedVault] = _resourcesByType.try_emplace(typeid(R));
             if (emplacedVault) {
                 itVault->second = new VaultById<R>();
@@ -180,22 +227,41 @@ namespace Rise {
                 }
             }
 
+            std::shared_ptr<R> resource;
             if (data._resources.empty() || !cached) {
-                auto resource = _manager.CreateRes<R>(&data._meta);
+                resource = _manager.CreateRes<R>(&data._meta);
                 data._resources.emplace_back(resource);
+                resource->_cached.store(true);
+            }
+            else if (data._resources.front()->loadState() == R::LoadState::Unloaded) {
+                // its load was cancelled once nobody held it, it's wanted again
+                resource = data._resources.front();
+            }
 
+            if (resource) {
                 if constexpr (R::MetaOnly) {
-                    _loader.AddJob([resource]()
+                    // resources built from others list what they wait for
+                    std::vector<JobHandle> dependencies;
+                    if constexpr (requires { resource->Dependencies(); }) {
+                        dependencies = resource->Dependencies();
+                    }
+
+                    ScheduleLoad(resource, [](const std::shared_ptr<R>& resource, const CancellationToken&)
                         {
                             resource->Load();
-                        }
+                        }, std::move(dependencies), priority
                     );
                 }
                 else {
-                    _loader.AddJob([resourceFile, resource]()
+                    ScheduleLoad(resource, [resourceFile](const std::shared_ptr<R>& resource, const CancellationToken& token)
                         {
-                            resource->LoadFromFile(resourceFile);
-                        }
+                            if constexpr (requires { resource->LoadFromFile(resourceFile, token); }) {
+                                resource->LoadFromFile(resourceFile, token);
+                            }
+                            else {
+                                resource->LoadFromFile(resourceFile);
+                            }
+                        }, {}, priority
                     );
                 }
             }
@@ -203,6 +269,63 @@ namespace Rise {
             return *data._resources.begin();
         }
 
+        // The job holds the resource weakly until it starts, a resource evicted by then is never loaded.
+        // Touch() queues the job once more at the immediate priority, whichever copy runs first loads.
+        template <class R, class F>
+        void ScheduleLoad(const std::shared_ptr<R>& resource, F load, std::vector<JobHandle> dependencies, JobPriority priority) {
+            auto started = std::make_shared<std::atomic<bool>>(false);
+            auto job = [weakResource = std::weak_ptr<R>(resource), load = std::move(load), started]()
+            {
+                if (started->exchange(true)) {
+                    return;
+                }
+                auto resource = weakResource.lock();
+                if (!resource) {
+                    return;
+                }
+
+                resource->_loadRunning.store(true);
+                load(resource, CancellationToken(resource));
+                resource->_loadRunning.store(false);
+
+                if (resource->loadState() == R::LoadState::Loading) {
+                    // the data is still on its way to the gpu, callbacks hold `this` till then
+                    resource->OnLoaded([resource](bool) {});
+                }
+            };
+
+            resource->MarkLoading();
+            if (priority != JobPriority::Immediate) {
+                std::lock_guard<std::mutex> lg(resource->_lock);
+                resource->_boost = [this, job, dependencies, started]() {
+                    if (!started->load()) {
+                        _loader.AddJob(job, dependencies, JobPriority::Immediate);
+                    }
+                };
+            }
+            _loader.AddJob(std::move(job), dependencies, priority);
+        }
+
+        // the vault's reference is the only one, besides the one of a running load
+        template <class R>
+        static bool IsUnused(const std::shared_ptr<R>& resource) {
+            auto owners = resource.use_count();
+            if (resource->_loadRunning.load()) {
+                --owners;
+            }
+            return owners <= 1;
+        }
+
+        // for the vaults' erase_if, a running load sees the resource is no longer cached
+        template <class R>
+        static bool Evict(const std::shared_ptr<R>& resource) {
+            if (!IsUnused(resource)) {
+                return false;
+            }
+            resource->_cached.store(false);
+            return true;
+        }
+
         void IndexResourcesIndirectory(const std::filesystem::path& dir);
         void IndexResource(const std::string& filename);
 
@@ -215,6 +338,8 @@ namespace Rise {
         class VaultBase {
         public:
             virtual ~VaultBase() = default;
+
+            virtual uint32_t EvictUnused() = 0;
         };
 
         template <class R>
@@ -225,6 +350,20 @@ namespace Rise {
 
         template <class R>
         class VaultById : public std::unordered_map<std::string, ResourceData<R>>, public VaultBase {
+        public:
+            // the meta stays, it's cheap and needed to load the resource again
+            uint32_t EvictUnused() override {
+                uint32_t evicted = 0;
+                for (auto& pair : *this) {
+                    auto& resources = pair.second._resources;
+                    evicted += static_cast<uint32_t>(std::erase_if(resources, [](const std::shared_ptr<R>& ptr) {
+                        return Evict(ptr);
+                    }));
+                }
+                return evicted;
+            }
+
+        private:
             ~VaultById() {
                 for (auto& pair : *this) {
                     for (auto& ptr : pair.second._resources) {
@@ -236,6 +375,14 @@ namespace Rise {
 
         template <class R, class K>
         class VaultByKey : public std::unordered_map<K, std::shared_ptr<R>>, public VaultBase {
+        public:
+            uint32_t EvictUnused() override {
+                return static_cast<uint32_t>(std::erase_if(*this, [](const auto& pair) {
+                    return Evict(pair.second);
+                }));
+            }
+
+        private:
             ~VaultByKey() {
                 for (auto& pair : *this) {
                     auto useCount = pair.second.use_count();
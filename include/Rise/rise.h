@@ -13,6 +13,7 @@
 #include <vector>
 #include <optional>
 #include <mutex>
+#include <functional>
 
 #ifndef RISE_RESOURCE_DIRECTORY
 #define RISE_RESOURCE_DIRECTORY ""
@@ -26,6 +27,7 @@ namespace Rise {
     class Loader;
     class ResourceManager;
     class ResourceGenerator;
+    class UploadQueue;
 
     class Core {
     public:
@@ -40,6 +42,10 @@ namespace Rise {
 
         void Loop();
 
+        // runs `task` on the main thread at the start of the next frame, any thread may post.
+        // Once the core shuts down tasks are dropped instead.
+        void Post(std::function<void()> task);
+
         Rise::ResourceGenerator& ResourceGenerator() {
             return *_resourceGenerator;
         }
@@ -52,12 +58,17 @@ namespace Rise {
         Rise::Logger& Logger() {
             return *_logger;
         }
+        Rise::UploadQueue& Uploads() {
+            return *_uploads;
+        }
 
     private:
 
         friend Window;
         friend class GpuAllocator;
         friend class GpuStackAllocator;
+        friend class GpuAliasAllocator;
+        friend class UploadQueue;
         friend class GraphicsPipeline;
         friend class Resource;
 
@@ -107,10 +118,13 @@ namespace Rise {
         bool IsDeviceSuitable(const VkPhysicalDevice& device, const VkSurfaceKHR& surface);
         bool CheckDeviceExtensionSupport(const VkPhysicalDevice& device);
         void AddOptionalExtensions(std::vector<const char*>& deviceExtensions);
+        bool IsDeviceExtensionAvailable(const char* extensionName);
 
         struct QueueFamilyIndices {
             std::optional<uint32_t> graphicsFamily;
             std::optional<uint32_t> presentFamily;
+            // family without graphics support, only set when the device has one
+            std::optional<uint32_t> transferFamily;
 
             bool IsComplete() {
                 return graphicsFamily.has_value() && presentFamily.has_value();
@@ -136,6 +150,11 @@ namespace Rise {
         VkDebugUtilsMessengerEXT _vDebugMessenger;
 
         VkPhysicalDevice _vPhysicalDevice = VK_NULL_HANDLE;
+        VkPhysicalDeviceProperties _vPhysicalDeviceProperties{};
+        VkPhysicalDeviceMemoryProperties _vMemoryProperties{};
+
+        // VK_EXT_memory_budget is enabled
+        bool _memoryBudgetSupported = false;
 
         VkDevice _vDevice;
         std::recursive_mutex _deviceLock;
@@ -144,17 +163,25 @@ namespace Rise {
 
         VkQueue _vGraphicsQueue;
         VkQueue _vPresentQueue;
+        // same as the graphics queue when there is no separate transfer family
+        VkQueue _vTransferQueue;
 
         VkCommandPool _vCommandPool;
-        VkCommandPool _vInstantCommandPool;
 
         Rise::Logger* _logger = nullptr;
+        Rise::UploadQueue* _uploads = nullptr;
         Rise::Loader* _loader = nullptr;
         Rise::ResourceManager* _resources = nullptr;
         Rise::ResourceGenerator* _resourceGenerator = nullptr;
 
         FT_Library  _freeTypeLibrary;
 
+        uint32_t _memoryPressureCallback = 0;
+
+        std::mutex _postedLock;
+        std::vector<std::function<void()>> _posted;
+        bool _postsClosed = false;
+
         uint64_t _globalFrameCounter = 0;
     };
 
@@ -0,0 +1,71 @@
+//☀Rise☀
+#ifndef slab_allocator_h
+#define slab_allocator_h
+
+#include "allocator.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#ifndef RISE_SLAB_POOL_BYTES
+#define RISE_SLAB_POOL_BYTES (256 * 1024)
+#endif //RISE_SLAB_POOL_BYTES
+
+namespace Rise {
+
+    // Set of fixed size Allocators, one per size class: 16 byte steps up to 1 KiB,
+    // then powers of two up to 64 KiB. Every class is created up front,
+    // so picking a class never takes a lock. Bigger requests go to the heap.
+    class SlabAllocator {
+    public:
+
+        static constexpr size_t SmallStep = 16;
+        static constexpr size_t SmallLimit = 1024;
+        static constexpr size_t LargeLimit = 64 * 1024;
+
+        SlabAllocator(Allocator::Backend backend = Allocator::DefaultBackend);
+
+        SlabAllocator(const SlabAllocator&) = delete;
+        SlabAllocator& operator=(const SlabAllocator&) = delete;
+
+        template <class T>
+        void destroy(T* t) {
+            if (t == nullptr) {
+                return;
+            }
+
+            t->~T();
+            deallocate(t, sizeof(T));
+        }
+
+        void* allocate(size_t size);
+        void deallocate(void* ptr, size_t size);
+
+        uint32_t allocated() const;
+
+        // only the classes that have ever been used
+        std::vector<Allocator::Statistics> statistics() const;
+
+        uint32_t Trim();
+        void SetAutoTrim(float lowWatermark);
+
+    private:
+
+        static constexpr size_t SmallClasses = SmallLimit / SmallStep;
+        static constexpr size_t LargeClasses = 6; // 2, 4, 8, 16, 32, 64 KiB
+        static constexpr size_t ClassCount = SmallClasses + LargeClasses;
+
+        static size_t ClassIndex(size_t size);
+
+        std::array<std::unique_ptr<Allocator>, ClassCount> _classes;
+
+        std::atomic<uint32_t> _heapAllocations = 0;
+    };
+
+}
+
+#endif /* slab_allocator_h */
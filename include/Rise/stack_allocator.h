@@ -0,0 +1,83 @@
+//☀Rise☀
+#ifndef stack_allocator_h
+#define stack_allocator_h
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#ifndef RISE_STACK_ALLOCATOR_CHUNK_SIZE
+#define RISE_STACK_ALLOCATOR_CHUNK_SIZE (64 * 1024)
+#endif //RISE_STACK_ALLOCATOR_CHUNK_SIZE
+
+namespace Rise {
+
+    // Bump arena for objects that all die at the same moment.
+    // Deallocation is a no-op, Reset() rewinds to the start and keeps the chunks,
+    // so after a few warm-up cycles it stops touching the heap at all.
+    // Not thread safe.
+    class StackAllocator {
+    public:
+
+        explicit StackAllocator(size_t chunkSize = RISE_STACK_ALLOCATOR_CHUNK_SIZE);
+        ~StackAllocator();
+
+        StackAllocator(const StackAllocator&) = delete;
+        StackAllocator& operator=(const StackAllocator&) = delete;
+
+        void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+        void Reset();
+
+    private:
+
+        struct Chunk {
+            uint8_t* data;
+            size_t size;
+        };
+
+        void* TryAllocate(Chunk& chunk, size_t offset, size_t size, size_t alignment);
+
+        const size_t _chunkSize;
+
+        std::vector<Chunk> _chunks;
+        size_t _chunkIndex = 0;
+        size_t _offset = 0;
+    };
+
+    // std allocator over StackAllocator, for containers that live no longer than the arena's cycle
+    template <class T>
+    class StackStlAllocator {
+    public:
+        using value_type = T;
+
+        StackStlAllocator(StackAllocator& stack)
+            : _stack(&stack) {}
+        template <class U>
+        StackStlAllocator(const StackStlAllocator<U>& other)
+            : _stack(other._stack) {}
+
+        T* allocate(size_t n) {
+            return static_cast<T*>(_stack->allocate(sizeof(T) * n, alignof(T)));
+        }
+        void deallocate(T*, size_t) {}
+
+        template <class U>
+        friend bool operator==(const StackStlAllocator<T>& lhs, const StackStlAllocator<U>& rhs) {
+            return lhs._stack == rhs._stack;
+        }
+        template <class U>
+        friend bool operator!=(const StackStlAllocator<T>& lhs, const StackStlAllocator<U>& rhs) {
+            return lhs._stack != rhs._stack;
+        }
+
+    private:
+        template <class U>
+        friend class StackStlAllocator;
+
+        StackAllocator* _stack;
+    };
+
+}
+
+#endif /* stack_allocator_h */
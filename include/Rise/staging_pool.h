@@ -0,0 +1,65 @@
+//☀Rise☀
+#ifndef staging_pool_h
+#define staging_pool_h
+
+#include "gpu_allocator.h"
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// the smallest bucket, every next one is twice as big
+#ifndef RISE_STAGING_POOL_MIN_SIZE
+#define RISE_STAGING_POOL_MIN_SIZE (64 * 1024)
+#endif //RISE_STAGING_POOL_MIN_SIZE
+
+#ifndef RISE_STAGING_POOL_BUCKETS
+#define RISE_STAGING_POOL_BUCKETS 9
+#endif //RISE_STAGING_POOL_BUCKETS
+
+// free buffers kept per bucket, the rest is destroyed on release
+#ifndef RISE_STAGING_POOL_BUCKET_CAPACITY
+#define RISE_STAGING_POOL_BUCKET_CAPACITY 8
+#endif //RISE_STAGING_POOL_BUCKET_CAPACITY
+
+namespace Rise {
+
+    // Host visible transfer source buffers in power of two sized buckets.
+    // A buffer goes back to the pool once the copy reading it has completed,
+    // usually from the upload queue's completion callback.
+    // Requests bigger than the last bucket get a buffer of their own.
+    class StagingPool {
+    public:
+
+        StagingPool() = default;
+        ~StagingPool();
+
+        StagingPool(const StagingPool&) = delete;
+        StagingPool& operator=(const StagingPool&) = delete;
+
+        // at least `size` bytes, persistently mapped and coherent
+        GpuAllocator::Buffer Acquire(VkDeviceSize size);
+        void Release(GpuAllocator::Buffer buffer);
+
+        // destroys the free buffers, returns how many
+        uint32_t Trim();
+
+    private:
+
+        static constexpr uint32_t Unpooled = RISE_STAGING_POOL_BUCKETS;
+
+        static uint32_t BucketOf(VkDeviceSize size);
+
+        std::mutex _lock;
+        std::array<std::vector<GpuAllocator::Buffer>, RISE_STAGING_POOL_BUCKETS> _freeBuffers;
+        // bucket of every buffer handed out
+        std::unordered_map<VkBuffer, uint32_t> _bucketByBuffer;
+    };
+
+}
+
+#endif /* staging_pool_h */
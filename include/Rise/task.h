@@ -0,0 +1,172 @@
+//☀Rise☀
+#ifndef rise_task_h
+#define rise_task_h
+
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <utility>
+
+namespace Rise {
+
+    // where a suspended coroutine continues
+    enum class ResumeOn {
+        // the loader's workers
+        Loader,
+        // the thread running Core::Loop, once per frame
+        MainThread,
+    };
+
+    // Fire and forget coroutine, starts right away and frees itself once finished.
+    // Dropping the Task cancels it: a suspended coroutine is destroyed instead of
+    // resumed, so one resumed on the main thread may safely use the object owning the Task.
+    class Task {
+    public:
+
+        struct State {
+            std::atomic<bool> cancelled = false;
+        };
+
+        struct promise_type {
+            Task get_return_object() {
+                return Task(state);
+            }
+            std::suspend_never initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() {
+                std::terminate();
+            }
+
+            std::shared_ptr<State> state = std::make_shared<State>();
+        };
+
+        Task() = default;
+        ~Task() {
+            Cancel();
+        }
+
+        Task(Task&& other) noexcept
+            : _state(std::move(other._state)) {}
+        Task& operator=(Task&& other) noexcept {
+            if (this != &other) {
+                Cancel();
+                _state = std::move(other._state);
+            }
+            return *this;
+        }
+
+        Task(const Task&) = delete;
+        Task& operator=(const Task&) = delete;
+
+        void Cancel() {
+            if (_state) {
+                _state->cancelled.store(true, std::memory_order_relaxed);
+                _state.reset();
+            }
+        }
+
+    private:
+
+        explicit Task(std::shared_ptr<State> state)
+            : _state(std::move(state)) {}
+
+        std::shared_ptr<State> _state;
+    };
+
+    // Owns a suspended coroutine until it's resumed or handed on, destroys it if neither happens
+    class Resumption {
+    public:
+
+        explicit Resumption(std::coroutine_handle<Task::promise_type> handle)
+            : _handle(handle) {}
+        ~Resumption() {
+            if (_handle) {
+                _handle.destroy();
+            }
+        }
+
+        Resumption(const Resumption&) = delete;
+        Resumption& operator=(const Resumption&) = delete;
+
+        // resumes the coroutine, or destroys it when its Task was cancelled by then
+        void operator()() {
+            auto handle = Release();
+            if (handle.promise().state->cancelled.load(std::memory_order_relaxed)) {
+                handle.destroy();
+            }
+            else {
+                handle.resume();
+            }
+        }
+
+        std::coroutine_handle<Task::promise_type> Release() {
+            return std::exchange(_handle, nullptr);
+        }
+
+    private:
+
+        std::coroutine_handle<Task::promise_type> _handle;
+    };
+
+    // Resumes `handle` on `resumeOn`, or destroys it when its Task was cancelled by then.
+    // A coroutine whose resumption is never run is destroyed along with it.
+    void Resume(ResumeOn resumeOn, std::coroutine_handle<Task::promise_type> handle);
+
+    // co_await SwitchTo(ResumeOn::Loader) continues the coroutine on the loader
+    struct SwitchTo {
+        ResumeOn resumeOn;
+
+        bool await_ready() const noexcept {
+            return false;
+        }
+        void await_suspend(std::coroutine_handle<Task::promise_type> handle) const {
+            Resume(resumeOn, handle);
+        }
+        void await_resume() const noexcept {}
+    };
+
+    // Result of ResourceGenerator::GetAsync(), suspends until the resource has finished loading.
+    // Gives the resource, or nullptr when it didn't end up loaded or is gone.
+    // While suspended the resource holds the coroutine, which only holds it weakly back,
+    // so a cancelled Task doesn't keep its resource loading.
+    template <class R>
+    class ResourceAwaiter {
+    public:
+
+        ResourceAwaiter(std::shared_ptr<R> resource, ResumeOn resumeOn)
+            : _resource(std::move(resource)), _resumeOn(resumeOn) {}
+
+        bool await_ready() const {
+            return _resource->loadState() != R::LoadState::Loading;
+        }
+        void await_suspend(std::coroutine_handle<Task::promise_type> handle) {
+            auto resource = std::move(_resource);
+            _weakResource = resource;
+
+            // the callback may run right away, or on another thread before this returns.
+            // A resource dropped before it finished destroys the coroutine with the callback.
+            auto resumption = std::make_shared<Resumption>(handle);
+            resource->OnLoaded([resumeOn = _resumeOn, resumption](bool) {
+                Resume(resumeOn, resumption->Release());
+            });
+        }
+        std::shared_ptr<R> await_resume() {
+            auto resource = _resource ? std::move(_resource) : _weakResource.lock();
+            if (!resource || !resource->IsLoaded()) {
+                return nullptr;
+            }
+            return resource;
+        }
+
+    private:
+
+        std::shared_ptr<R> _resource;
+        std::weak_ptr<R> _weakResource;
+        ResumeOn _resumeOn;
+    };
+
+}
+
+#endif /* rise_task_h */
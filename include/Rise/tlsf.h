@@ -0,0 +1,132 @@
+//☀Rise☀
+#ifndef tlsf_h
+#define tlsf_h
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace Rise {
+
+    // Two-level segregated fit allocator over abstract offset ranges.
+    // Knows nothing about what the ranges are backed by, every region is
+    // an independent span [0, size) and allocations never cross regions.
+    // Allocation and freeing are O(1): free ranges are kept in size-class
+    // lists found through two bitmaps, neighbours are merged through
+    // physical links instead of searching.
+    class Tlsf {
+    public:
+
+        using Handle = uint32_t;
+        static constexpr Handle InvalidHandle = std::numeric_limits<Handle>::max();
+
+        Tlsf();
+
+        struct Allocation {
+            Handle handle = InvalidHandle;
+            uint32_t region = 0;
+            uint64_t offset = 0;
+            uint64_t size = 0;
+        };
+
+        // returns index of the new region, indices of removed regions are reused
+        uint32_t AddRegion(uint64_t size);
+        // the region has to be completely free
+        void RemoveRegion(uint32_t region);
+
+        // nothing is allocated from a locked region, freeing into it still works
+        void LockRegion(uint32_t region);
+        void UnlockRegion(uint32_t region);
+
+        // alignment has to be a power of two
+        bool Allocate(uint64_t size, uint64_t alignment, Allocation& allocation);
+        void Free(Handle handle);
+
+        uint64_t regionSize(uint32_t region) const {
+            return _regions[region].size;
+        }
+        uint64_t regionUsed(uint32_t region) const {
+            return _regions[region].used;
+        }
+
+        // walks the whole region, meant for statistics
+        uint64_t regionLargestFree(uint32_t region) const;
+
+        bool regionActive(uint32_t region) const {
+            return _regions[region].first != Null;
+        }
+        bool regionLocked(uint32_t region) const {
+            return _regions[region].locked;
+        }
+
+        // removed regions are counted as well, check regionActive
+        uint32_t regionCount() const {
+            return static_cast<uint32_t>(_regions.size());
+        }
+
+    private:
+
+        static constexpr uint32_t SlBits = 5;
+        static constexpr uint32_t SlCount = 1u << SlBits;
+        static constexpr uint32_t FlCount = 64 - SlBits + 1;
+
+        static constexpr uint32_t Null = std::numeric_limits<uint32_t>::max();
+
+        struct Node {
+            uint64_t offset = 0;
+            uint64_t size = 0;
+            uint32_t region = 0;
+
+            // neighbours in memory, boundary tags of the region
+            uint32_t prevPhysical = Null;
+            uint32_t nextPhysical = Null;
+
+            // neighbours in the size-class list, only while free
+            uint32_t prevFree = Null;
+            uint32_t nextFree = Null;
+
+            bool free = false;
+        };
+
+        struct Region {
+            uint64_t size = 0;
+            uint64_t used = 0;
+            // node at offset 0, it's never merged away, Null once the region is removed
+            uint32_t first = Null;
+            bool locked = false;
+        };
+
+        static void MappingInsert(uint64_t size, uint32_t& fl, uint32_t& sl);
+        static void MappingSearch(uint64_t size, uint32_t& fl, uint32_t& sl);
+
+        uint32_t FindSuitable(uint32_t fl, uint32_t sl) const;
+        bool Fits(uint32_t index, uint64_t size, uint64_t alignment) const;
+
+        void InsertFree(uint32_t index);
+        void RemoveFree(uint32_t index);
+
+        // same as above, but free nodes of locked regions are kept out of the lists
+        void AttachFree(uint32_t index);
+        void DetachFree(uint32_t index);
+
+        uint32_t NewNode();
+        void ReleaseNode(uint32_t index);
+
+        // cuts `size` from the beginning of a used node, the rest becomes a free node
+        void SplitTail(uint32_t index, uint64_t size);
+
+        std::vector<Node> _nodes;
+        std::vector<uint32_t> _unusedNodes;
+
+        std::vector<Region> _regions;
+        std::vector<uint32_t> _unusedRegions;
+
+        uint64_t _flBitmap = 0;
+        std::array<uint32_t, FlCount> _slBitmaps{};
+        std::array<std::array<uint32_t, SlCount>, FlCount> _heads;
+    };
+
+}
+
+#endif /* tlsf_h */
@@ -5,10 +5,12 @@
 #include "render_pass.h"
 #include "resource.h"
 #include "gpu_allocator.h"
+#include "stack_allocator.h"
 #include "utils.h"
 
 #include <vulkan/vulkan.h>
 
+#include <map>
 
 namespace Rise {
 
@@ -17,31 +19,45 @@ namespace Rise {
         virtual ~UniformSetter() = default;
 
         virtual bool Ready() { return true; }
+
+        virtual bool Dynamic() const { return false; }
+        virtual uint32_t DynamicOffset() const { return 0; }
     };
 
     class BufferUniformSetter : public UniformSetter {
         friend Window;
 
     public:
-        static constexpr VkDescriptorType DescriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        static constexpr VkDescriptorType DescriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 
-        explicit BufferUniformSetter(VkDescriptorSet vDescriptorSet, uint32_t binding, const std::vector<uint8_t>& data) {
-            Init(vDescriptorSet, binding, data.size());
-            UpdateUniformBuffer(data);
+        // data is copied into the frame's upload stack, it lives until the stack is reset
+        explicit BufferUniformSetter(VkDescriptorSet vDescriptorSet, uint32_t binding, const std::vector<uint8_t>& data, GpuStackAllocator& uploadStack) {
+            Init(vDescriptorSet, binding, data, uploadStack);
         };
-        virtual ~BufferUniformSetter() {
-            Destroy();
+        // data is already in place and the descriptor set already points to its buffer
+        explicit BufferUniformSetter(const GpuStackAllocator::Allocation& allocation)
+            : _allocation(allocation) {}
+        virtual ~BufferUniformSetter() {}
+
+        bool Ready() override {
+            return static_cast<bool>(_allocation);
         }
 
-    private:
+        bool Dynamic() const override {
+            return true;
+        }
+        uint32_t DynamicOffset() const override {
+            return static_cast<uint32_t>(_allocation.offset);
+        }
 
-        void Init(VkDescriptorSet vDescriptorSet, uint32_t binding, VkDeviceSize size);
-        void Destroy();
+        // descriptor covers [0, range) of the buffer, draws pick their data with the dynamic offset
+        static void WriteDescriptor(VkDescriptorSet vDescriptorSet, uint32_t binding, VkBuffer vBuffer, VkDeviceSize range);
 
-        void InitBuffer(VkDeviceSize size);
-        void UpdateUniformBuffer(const std::vector<uint8_t>& data);
+    private:
 
-        GpuAllocator::Buffer uniformBuffer;
+        void Init(VkDescriptorSet vDescriptorSet, uint32_t binding, const std::vector<uint8_t>& data, GpuStackAllocator& uploadStack);
+
+        GpuStackAllocator::Allocation _allocation;
     };
 
     class IImage;
@@ -61,7 +77,7 @@ namespace Rise {
         virtual ~ImageUniformSetter() {}
 
         bool Ready() override {
-            return _image && _image->IsLoaded();
+            return _image && _image->Touch();
         }
 
     private:
@@ -122,10 +138,17 @@ namespace Rise {
         friend class Renderer;
 
     public:
-        explicit Uniform(Core* core, DescriptorPoolData& poolData, const Renderer::SetLayout& layout)
-            : RiseObject(core) {
+        // ordered by binding, the way vulkan expects dynamic offsets
+        using Setters = std::map<uint16_t, std::shared_ptr<UniformSetter>, std::less<uint16_t>,
+            StackStlAllocator<std::pair<const uint16_t, std::shared_ptr<UniformSetter>>>>;
+
+        explicit Uniform(Core* core, StackAllocator& frameStack, DescriptorPoolData& poolData, const Renderer::SetLayout& layout)
+            : RiseObject(core), setters(Setters::allocator_type(frameStack)) {
             Init(poolData, layout);
         };
+        // set shared with other draws
+        explicit Uniform(Core* core, StackAllocator& frameStack, VkDescriptorSet vSharedDescriptorSet)
+            : RiseObject(core), vDescriptorSet(vSharedDescriptorSet), setters(Setters::allocator_type(frameStack)) {}
 
         void Init(DescriptorPoolData& poolData, const Renderer::SetLayout& layout);
 
@@ -138,8 +161,18 @@ namespace Rise {
             return true;
         }
 
+        uint32_t DynamicOffsets(uint32_t* offsets, uint32_t capacity) const {
+            uint32_t count = 0;
+            for (auto& setter : setters) {
+                if (setter.second->Dynamic() && count < capacity) {
+                    offsets[count++] = setter.second->DynamicOffset();
+                }
+            }
+            return count;
+        }
+
         VkDescriptorSet vDescriptorSet;
-        std::unordered_map<uint16_t, std::shared_ptr<UniformSetter>> setters;
+        Setters setters;
     };
 }
 
@@ -0,0 +1,148 @@
+//☀Rise☀
+#ifndef upload_queue_h
+#define upload_queue_h
+
+#include "gpu_allocator.h"
+#include "staging_pool.h"
+
+#include <vulkan/vulkan.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Rise {
+
+    // Collects copies from any thread and submits them in one command buffer per Tick().
+    // Every submit signals the next value of a timeline semaphore, completion callbacks
+    // run once the gpu has reached it, so nothing ever waits for the whole queue.
+    // Copies run on the transfer queue family when the device has a separate one,
+    // the graphics queue then acquires ownership of the results before they count as done.
+    // Callbacks run on the thread ticking the queue, where draws read the handles they swap.
+    class UploadQueue {
+    public:
+
+        // timeline value of the batch a copy went into, 0 means nothing to wait for
+        using Ticket = uint64_t;
+        using Callback = std::function<void()>;
+
+        UploadQueue();
+        ~UploadQueue();
+
+        UploadQueue(const UploadQueue&) = delete;
+        UploadQueue& operator=(const UploadQueue&) = delete;
+
+        Ticket CopyBuffer(GpuAllocator::Buffer srcBuffer, GpuAllocator::Buffer dstBuffer, VkDeviceSize size, Callback onComplete = {});
+        // leaves the image in the shader read only layout
+        Ticket CopyBufferToImage(GpuAllocator::Buffer srcBuffer, GpuAllocator::Image dstImage, const VkExtent3D& extent, Callback onComplete = {});
+
+        // Copies of resources the graphics queue may be reading right now, they always run on it.
+        // Images are expected to be in the shader read only layout, both stay in it.
+        Ticket MoveBuffer(GpuAllocator::Buffer srcBuffer, GpuAllocator::Buffer dstBuffer, VkDeviceSize size, Callback onComplete = {});
+        Ticket MoveImage(GpuAllocator::Image srcImage, GpuAllocator::Image dstImage, const VkExtent3D& extent, Callback onComplete = {});
+
+        // Runs callbacks of the finished batches and submits everything recorded since the last tick.
+        // Called by the core once per frame.
+        void Tick();
+
+        // Blocks until the batch of the ticket is done and its callbacks have run,
+        // submits the batch first if it's still pending.
+        // Other threads than the ticking one wait for its next Tick() to run the callbacks.
+        void Wait(Ticket ticket);
+
+        // No more frames are drawn, from now on Wait() runs the callbacks on any thread.
+        // Called by the core before it shuts down.
+        void EndFrames();
+
+        bool IsComplete(Ticket ticket) const;
+
+        // source buffers for uploads, released from the completion callback
+        StagingPool& Staging() {
+            return _staging;
+        }
+
+    private:
+
+        struct Copy {
+            // moves copy between two resources on the graphics queue, uploads read a staging buffer
+            bool move = false;
+
+            // exactly one of the sources is set
+            GpuAllocator::Buffer srcBuffer;
+            GpuAllocator::Image srcImage;
+
+            // exactly one of the destinations is set
+            GpuAllocator::Buffer dstBuffer;
+            GpuAllocator::Image dstImage;
+
+            VkDeviceSize size = 0;
+            VkExtent3D extent{};
+        };
+
+        struct Batch {
+            Ticket ticket = 0;
+            VkCommandBuffer vCommandBuffer = VK_NULL_HANDLE;
+            VkCommandBuffer vAcquireCommandBuffer = VK_NULL_HANDLE;
+            std::vector<Callback> callbacks;
+        };
+
+        Ticket Emplace(const Copy& copy, Callback&& onComplete);
+
+        void Submit();
+        static void Begin(VkCommandBuffer vCommandBuffer);
+
+        void Record(VkCommandBuffer vCommandBuffer, const std::vector<Copy>& copies);
+        void RecordAcquire(VkCommandBuffer vCommandBuffer, const std::vector<Copy>& copies);
+        void RecordMoves(VkCommandBuffer vCommandBuffer, const std::vector<Copy>& moves);
+        void Collect();
+
+        bool SeparateTransfer() const {
+            return _transferFamily != _graphicsFamily;
+        }
+
+        VkCommandBuffer AllocateCommandBuffer(VkCommandPool vCommandPool);
+
+        uint32_t _graphicsFamily = 0;
+        uint32_t _transferFamily = 0;
+
+        // on the transfer family
+        VkCommandPool _vCommandPool = VK_NULL_HANDLE;
+        // on the graphics family, ownership acquires only
+        VkCommandPool _vAcquirePool = VK_NULL_HANDLE;
+
+        // reached once a batch is usable by the graphics queue
+        VkSemaphore _vTimeline = VK_NULL_HANDLE;
+        // reached once the copies of a batch are done, separate transfer family only
+        VkSemaphore _vTransferTimeline = VK_NULL_HANDLE;
+
+        // copies waiting for the next submit
+        std::mutex _pendingLock;
+        std::vector<Copy> _pendingCopies;
+        std::vector<Callback> _pendingCallbacks;
+        Ticket _nextTicket = 1;
+
+        // guards the command pool and the batches in flight
+        std::mutex _submitLock;
+        std::deque<Batch> _inFlight;
+
+        // held while callbacks run, so Wait() returns only after they are done
+        std::recursive_mutex _completionLock;
+
+        // the one running Tick(), the core's main thread
+        std::thread::id _tickThread = std::this_thread::get_id();
+        // the last batch whose callbacks have run
+        std::mutex _collectedLock;
+        std::condition_variable _collectedCond;
+        Ticket _collected = 0;
+        bool _framesEnded = false;
+
+        StagingPool _staging;
+    };
+
+}
+
+#endif /* upload_queue_h */
@@ -5,6 +5,7 @@
 #include "rise_object.h"
 #include "resource.h"
 #include "gpu_allocator.h"
+#include "upload_queue.h"
 #include "utils.h"
 
 #include <vulkan/vulkan.h>
@@ -117,12 +118,14 @@ namespace Rise {
         Vertices(Core* core, const Meta* meta)
             : IVertices(core), _meta(meta) {};
         ~Vertices() override {
+            Instance()->Uploads().Wait(_upload);
             if (IsLoaded()) {
                 Unload();
             }
         }
 
-        void LoadFromFile(const std::string& filename);
+        // stops early and stays unloaded once `token` is cancelled
+        void LoadFromFile(const std::string& filename, const CancellationToken& token = {});
         void Unload() override;
 
         const Meta& meta() const override {
@@ -137,6 +140,8 @@ namespace Rise {
 
         const Meta* _meta = nullptr;
         GpuAllocator::Buffer _vertexBuffer;
+        UploadQueue::Ticket _upload = 0;
+        std::shared_ptr<GpuAllocator::RelocationGuard> _relocation;
     };
 
     class CustomVertices : public IVertices {
@@ -147,6 +152,7 @@ namespace Rise {
         explicit CustomVertices(Core* core)
             : IVertices(core) {}
         ~CustomVertices() override {
+            Instance()->Uploads().Wait(_upload);
             if (IsLoaded()) {
                 Unload();
             }
@@ -191,6 +197,8 @@ namespace Rise {
 
         Meta _meta;
         GpuAllocator::Buffer _vertexBuffer;
+        UploadQueue::Ticket _upload = 0;
+        std::shared_ptr<GpuAllocator::RelocationGuard> _relocation;
     };
 }
 
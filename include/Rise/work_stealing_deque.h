@@ -0,0 +1,134 @@
+//☀Rise☀
+#ifndef work_stealing_deque_h
+#define work_stealing_deque_h
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace Rise {
+
+    // Chase-Lev deque. The owner thread pushes and pops at the bottom,
+    // any other thread steals from the top. Only pointers are stored,
+    // so that slots can be read and written atomically.
+    // Outgrown arrays are kept until the deque dies, a thief may still read from one.
+    template <class T>
+    class WorkStealingDeque {
+        static_assert(std::is_pointer_v<T>, "WorkStealingDeque stores pointers only");
+
+    public:
+
+        // capacity has to be a power of two
+        explicit WorkStealingDeque(int64_t capacity = 256)
+            : _array(new Array(capacity)) {}
+        ~WorkStealingDeque() {
+            delete _array.load(std::memory_order_relaxed);
+        }
+
+        WorkStealingDeque(const WorkStealingDeque&) = delete;
+        WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+        // owner only
+        void Push(T item) {
+            auto bottom = _bottom.load(std::memory_order_relaxed);
+            auto top = _top.load(std::memory_order_acquire);
+            auto* array = _array.load(std::memory_order_relaxed);
+
+            if (bottom - top > array->capacity - 1) {
+                _retired.emplace_back(array);
+                array = array->Grow(bottom, top);
+                _array.store(array, std::memory_order_release);
+            }
+
+            array->Put(bottom, item);
+            // publishes the item to thieves acquiring the bottom
+            _bottom.store(bottom + 1, std::memory_order_release);
+        }
+
+        // owner only, takes the most recently pushed item
+        bool Pop(T& item) {
+            auto bottom = _bottom.load(std::memory_order_relaxed) - 1;
+            auto* array = _array.load(std::memory_order_relaxed);
+            _bottom.store(bottom, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            auto top = _top.load(std::memory_order_relaxed);
+
+            if (top > bottom) {
+                _bottom.store(bottom + 1, std::memory_order_relaxed);
+                return false;
+            }
+
+            item = array->Get(bottom);
+            if (top == bottom) {
+                // the last one, thieves may want it too
+                auto won = _top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+                _bottom.store(bottom + 1, std::memory_order_relaxed);
+                return won;
+            }
+            return true;
+        }
+
+        // any thread, takes the oldest item, fails on a lost race as well
+        bool Steal(T& item) {
+            auto top = _top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            auto bottom = _bottom.load(std::memory_order_acquire);
+
+            if (top >= bottom) {
+                return false;
+            }
+
+            auto* array = _array.load(std::memory_order_acquire);
+            auto stolen = array->Get(top);
+            if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                return false;
+            }
+
+            item = stolen;
+            return true;
+        }
+
+        bool Empty() const {
+            auto bottom = _bottom.load(std::memory_order_relaxed);
+            auto top = _top.load(std::memory_order_relaxed);
+            return top >= bottom;
+        }
+
+    private:
+
+        struct Array {
+            explicit Array(int64_t capacity_)
+                : capacity(capacity_), items(new std::atomic<T>[capacity_]) {}
+
+            T Get(int64_t index) const {
+                return items[index & (capacity - 1)].load(std::memory_order_relaxed);
+            }
+            void Put(int64_t index, T item) {
+                items[index & (capacity - 1)].store(item, std::memory_order_relaxed);
+            }
+
+            Array* Grow(int64_t bottom, int64_t top) const {
+                auto* array = new Array(capacity * 2);
+                for (auto index = top; index < bottom; ++index) {
+                    array->Put(index, Get(index));
+                }
+                return array;
+            }
+
+            const int64_t capacity;
+            std::unique_ptr<std::atomic<T>[]> items;
+        };
+
+        alignas(64) std::atomic<int64_t> _top = 0;
+        alignas(64) std::atomic<int64_t> _bottom = 0;
+        alignas(64) std::atomic<Array*> _array;
+
+        // owner only
+        std::vector<std::unique_ptr<Array>> _retired;
+    };
+
+}
+
+#endif /* work_stealing_deque_h */
@@ -1,28 +1,493 @@
 //☀Rise☀
 #include "Rise/allocator.h"
 
+#include <algorithm>
+#include <new>
+#include <unordered_map>
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__linux__)
+#include <sys/mman.h>
+#endif
+
 namespace Rise {
 
-    Allocator::Allocator(uint32_t blockSize) 
-        : _blockSize(blockSize) {}
+    namespace {
+
+        std::atomic<uint64_t> allocatorIdCounter = 1;
+
+        // allocators alive right now, so that exiting threads know where they may return their magazines
+        std::mutex& RegistryLock() {
+            static std::mutex lock;
+            return lock;
+        }
+        std::unordered_map<uint64_t, Allocator*>& Registry() {
+            static std::unordered_map<uint64_t, Allocator*> registry;
+            return registry;
+        }
+
+        uint32_t AlignedBlockSize(uint32_t blockSize) {
+            constexpr uint32_t alignment = alignof(void*);
+            blockSize = std::max<uint32_t>(blockSize, sizeof(void*));
+            return (blockSize + alignment - 1) & ~(alignment - 1);
+        }
+
+        constexpr size_t PageSize = 4096;
+        constexpr size_t HugePageSize = 2 * 1024 * 1024;
+
+        size_t AlignUp(size_t value, size_t alignment) {
+            return (value + alignment - 1) & ~(alignment - 1);
+        }
+
+        // Reserves address space only, physical pages appear on first touch (Linux) or on commit (Windows)
+        uint8_t* ReserveRegion(size_t size) {
+#if defined(_WIN32)
+            return reinterpret_cast<uint8_t*>(VirtualAlloc(nullptr, size, MEM_RESERVE, PAGE_READWRITE));
+#elif defined(__linux__)
+            // over-reserve to be able to cut out a huge page aligned range
+            auto reserved = size + HugePageSize;
+            auto* raw = mmap(nullptr, reserved, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+            if (raw == MAP_FAILED) {
+                return nullptr;
+            }
+
+            auto begin = reinterpret_cast<uintptr_t>(raw);
+            auto aligned = AlignUp(begin, HugePageSize);
+            if (aligned > begin) {
+                munmap(raw, aligned - begin);
+            }
+            if (auto tail = begin + reserved - (aligned + size)) {
+                munmap(reinterpret_cast<void*>(aligned + size), tail);
+            }
+
+            madvise(reinterpret_cast<void*>(aligned), size, MADV_HUGEPAGE);
+            return reinterpret_cast<uint8_t*>(aligned);
+#else
+            return nullptr;
+#endif
+        }
+
+        void ReleaseRegion(uint8_t* region, [[maybe_unused]] size_t size) {
+#if defined(_WIN32)
+            VirtualFree(region, 0, MEM_RELEASE);
+#elif defined(__linux__)
+            munmap(region, size);
+#endif
+        }
+
+        bool CommitRange([[maybe_unused]] uint8_t* ptr, [[maybe_unused]] size_t size) {
+#if defined(_WIN32)
+            return VirtualAlloc(ptr, size, MEM_COMMIT, PAGE_READWRITE) != nullptr;
+#else
+            return true;
+#endif
+        }
+
+        void DecommitRange([[maybe_unused]] uint8_t* ptr, [[maybe_unused]] size_t size) {
+#if defined(_WIN32)
+            VirtualFree(ptr, size, MEM_DECOMMIT);
+#elif defined(__linux__)
+            madvise(ptr, size, MADV_DONTNEED);
+#endif
+        }
+
+    }
+
+    namespace {
+
+        // bumped by every destroyed allocator, tells threads to drop its magazine
+        std::atomic<uint64_t> destroyedAllocators = 0;
+
+    }
+
+    struct ThreadMagazines {
+        ~ThreadMagazines() {
+            std::lock_guard<std::mutex> lg(RegistryLock());
+            for (auto& [allocatorId, magazine] : magazines) {
+                auto it = Registry().find(allocatorId);
+                if (it != Registry().end()) {
+                    it->second->Release(magazine);
+                }
+            }
+        }
+
+        // drops magazines of allocators that are gone
+        void Prune() {
+            auto destroyed = destroyedAllocators.load(std::memory_order_acquire);
+            if (destroyed == seenDestroyed) {
+                return;
+            }
+            seenDestroyed = destroyed;
+
+            std::lock_guard<std::mutex> lg(RegistryLock());
+            std::erase_if(magazines, [](const auto& entry) {
+                return !Registry().contains(entry.first);
+            });
+            lastId = 0;
+            last = nullptr;
+        }
+
+        std::unordered_map<uint64_t, Allocator::Magazine> magazines;
+        uint64_t lastId = 0;
+        Allocator::Magazine* last = nullptr;
+        uint64_t seenDestroyed = 0;
+    };
+
+    Allocator::Allocator(uint32_t blockSize, uint32_t poolSize, Backend backend)
+        : _id(allocatorIdCounter.fetch_add(1, std::memory_order_relaxed)), _blockSize(AlignedBlockSize(blockSize)), _poolSize(std::max<uint32_t>(poolSize, 1)), _backend(backend) {
+        // page aligned pools can be handed back to the system one by one
+        _poolStride = AlignUp(static_cast<size_t>(_blockSize) * _poolSize, PageSize);
+
+        std::lock_guard<std::mutex> lg(RegistryLock());
+        Registry().emplace(_id, this);
+    }
     Allocator::~Allocator() {
+        {
+            std::lock_guard<std::mutex> lg(RegistryLock());
+            Registry().erase(_id);
+        }
+        destroyedAllocators.fetch_add(1, std::memory_order_release);
         for (auto& pool : _pools) {
-            ::operator delete(pool);
+            if (_region == nullptr || pool < _region || pool >= _region + RISE_ALLOCATOR_REGION_SIZE) {
+                ::operator delete(pool);
+            }
+        }
+        if (_region != nullptr) {
+            ReleaseRegion(_region, RISE_ALLOCATOR_REGION_SIZE);
         }
     }
 
     void* Allocator::allocate() {
-        if (_freeBlocks.empty()) {
-            auto* pool = _pools.emplace_back(reinterpret_cast<uint8_t *>(::operator new(_blockSize * RISE_ALLOCATOR_POOL_SIZE)));
-            for (ptrdiff_t i = 0; i < RISE_ALLOCATOR_POOL_SIZE; ++i) {
-                _freeBlocks.emplace_back(pool + _blockSize * i);
-            }
+        auto& magazine = LocalMagazine();
+        if (magazine.head == nullptr) {
+            Refill(magazine);
         }
-        auto ptr = _freeBlocks.back();
-        _freeBlocks.pop_back();
-        return ptr;
+
+        auto* block = magazine.head;
+        magazine.head = block->next;
+        --magazine.count;
+
+        // only this thread writes the counter, no need for a locked add
+        magazine.allocated.store(magazine.allocated.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return block;
     }
     void Allocator::deallocate(void* ptr) {
-        _freeBlocks.emplace_back(ptr);
+        auto& magazine = LocalMagazine();
+
+        auto* block = reinterpret_cast<FreeBlock*>(ptr);
+        block->next = magazine.head;
+        magazine.head = block;
+        ++magazine.count;
+
+        magazine.allocated.store(magazine.allocated.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+
+        if (magazine.count > 2 * RISE_ALLOCATOR_MAGAZINE_SIZE) {
+            Overflow(magazine);
+        }
+    }
+
+    Allocator::Magazine& Allocator::LocalMagazine() {
+        thread_local ThreadMagazines local;
+
+        if (local.lastId == _id) {
+            return *local.last;
+        }
+
+        local.Prune();
+
+        auto [it, inserted] = local.magazines.try_emplace(_id);
+        if (inserted) {
+            std::lock_guard<std::mutex> lg(_magazineLock);
+            _magazines.emplace_back(&it->second);
+        }
+
+        local.lastId = _id;
+        local.last = &it->second;
+        return it->second;
+    }
+
+    void Allocator::Fold(Magazine& magazine) {
+        auto allocated = magazine.allocated.exchange(0, std::memory_order_relaxed);
+        if (allocated != 0) {
+            _allocated.fetch_add(static_cast<uint32_t>(allocated), std::memory_order_relaxed);
+        }
+    }
+
+    void Allocator::Release(Magazine& magazine) {
+        if (magazine.head != nullptr) {
+            auto* last = magazine.head;
+            while (last->next != nullptr) {
+                last = last->next;
+            }
+            PushChain(magazine.head, last);
+            magazine.head = nullptr;
+            magazine.count = 0;
+        }
+
+        std::lock_guard<std::mutex> lg(_magazineLock);
+        Fold(magazine);
+        std::erase(_magazines, &magazine);
+    }
+
+    uint32_t Allocator::allocated() const {
+        std::lock_guard<std::mutex> lg(_magazineLock);
+        // goes below zero for a while when one thread frees what another allocated
+        int64_t allocated = static_cast<int32_t>(_allocated.load(std::memory_order_relaxed));
+        for (auto* magazine : _magazines) {
+            allocated += magazine->allocated.load(std::memory_order_relaxed);
+        }
+        return static_cast<uint32_t>(std::max<int64_t>(allocated, 0));
+    }
+
+    void Allocator::Refill(Magazine& magazine) {
+        Fold(magazine);
+
+        // pushes never take the lock, with a single popper at a time the blocks below the head
+        // can't go away and come back, so the pop doesn't suffer from ABA
+        FreeBlock* chain = nullptr;
+        FreeBlock* last = nullptr;
+        uint32_t count = 0;
+        {
+            std::lock_guard<std::mutex> lg(_popLock);
+            chain = _freeBlocks.load(std::memory_order_acquire);
+            do {
+                if (chain == nullptr) {
+                    break;
+                }
+
+                last = chain;
+                count = 1;
+                while (count < RISE_ALLOCATOR_MAGAZINE_SIZE && last->next != nullptr) {
+                    last = last->next;
+                    ++count;
+                }
+            } while (!_freeBlocks.compare_exchange_weak(chain, last->next, std::memory_order_acquire, std::memory_order_acquire));
+        }
+
+        if (chain == nullptr) {
+            chain = CreatePool();
+
+            last = chain;
+            count = 1;
+            while (count < RISE_ALLOCATOR_MAGAZINE_SIZE && last->next != nullptr) {
+                last = last->next;
+                ++count;
+            }
+
+            // rest of a fresh pool goes to the shared list, its blocks are linked in address order
+            if (auto* rest = last->next) {
+                auto* restLast = reinterpret_cast<FreeBlock*>(reinterpret_cast<uint8_t*>(chain) + static_cast<size_t>(_blockSize) * (_poolSize - 1));
+                PushChain(rest, restLast);
+            }
+        }
+
+        last->next = nullptr;
+        magazine.head = chain;
+        magazine.count = count;
+    }
+
+    void Allocator::Overflow(Magazine& magazine) {
+        Fold(magazine);
+
+        auto* first = magazine.head;
+        auto* last = first;
+        for (uint32_t i = 1; i < RISE_ALLOCATOR_MAGAZINE_SIZE; ++i) {
+            last = last->next;
+        }
+
+        magazine.head = last->next;
+        magazine.count -= RISE_ALLOCATOR_MAGAZINE_SIZE;
+
+        PushChain(first, last);
+
+        if (ShouldAutoTrim() && !_trimming.test_and_set(std::memory_order_acquire)) {
+            Trim();
+            _trimming.clear(std::memory_order_release);
+        }
+    }
+
+    bool Allocator::ShouldAutoTrim() const {
+        auto watermark = _autoTrimWatermark.load(std::memory_order_relaxed);
+        if (watermark <= 0.0f) {
+            return false;
+        }
+
+        auto capacity = this->capacity();
+        auto allocated = FoldedAllocated();
+        // there has to be at least a pool worth of free blocks for trimming to be of any use
+        if (capacity - allocated < _poolSize || allocated >= capacity * watermark) {
+            return false;
+        }
+
+        // with fragmented pools the last trim released nothing and the next one wouldn't either,
+        // it only starves concurrent refills, so wait until the usage has moved by a pool
+        auto distance = [](uint32_t a, uint32_t b) {
+            return a > b ? a - b : b - a;
+        };
+        if (distance(capacity, _trimCapacity.load(std::memory_order_relaxed)) >= _poolSize
+            || distance(allocated, _trimAllocated.load(std::memory_order_relaxed)) >= _poolSize) {
+            return true;
+        }
+
+        // or until a fully free pool is likely: the usage has halved,
+        // or there are too many free blocks for all pools to be in use
+        auto pools = capacity / _poolSize;
+        return allocated <= _trimAllocated.load(std::memory_order_relaxed) / 2 || capacity - allocated > pools * (_poolSize - 1);
+    }
+
+    uint32_t Allocator::FoldedAllocated() const {
+        // the magazines' share is off by at most a couple of magazines per thread
+        return static_cast<uint32_t>(std::max<int32_t>(static_cast<int32_t>(_allocated.load(std::memory_order_relaxed)), 0));
+    }
+
+    Allocator::Statistics Allocator::statistics() const {
+        Statistics statistics;
+        statistics.blockSize = _blockSize;
+        statistics.poolSize = _poolSize;
+        {
+            std::lock_guard<std::mutex> lg(_poolLock);
+            statistics.pools = static_cast<uint32_t>(_pools.size());
+        }
+        statistics.capacity = capacity();
+        statistics.allocated = allocated();
+        return statistics;
+    }
+
+    uint32_t Allocator::Trim() {
+        auto& magazine = LocalMagazine();
+        Fold(magazine);
+        if (magazine.head != nullptr) {
+            auto* last = magazine.head;
+            while (last->next != nullptr) {
+                last = last->next;
+            }
+            PushChain(magazine.head, last);
+            magazine.head = nullptr;
+            magazine.count = 0;
+        }
+
+        // while the list is taken no one else can hand out these blocks,
+        // so a pool whose every block is in it is safe to release.
+        // Refills wait for it rather than finding the list empty and growing.
+        std::lock_guard<std::mutex> popLock(_popLock);
+        auto* chain = _freeBlocks.exchange(nullptr, std::memory_order_acquire);
+        if (chain == nullptr) {
+            return 0;
+        }
+
+        std::lock_guard<std::mutex> lg(_poolLock);
+
+        auto poolIndex = [this](FreeBlock* block) {
+            auto it = std::upper_bound(_pools.begin(), _pools.end(), reinterpret_cast<uint8_t*>(block));
+            return static_cast<size_t>(it - _pools.begin()) - 1;
+        };
+
+        std::vector<uint32_t> freeCounts(_pools.size(), 0);
+        for (auto* block = chain; block != nullptr; block = block->next) {
+            ++freeCounts[poolIndex(block)];
+        }
+
+        FreeBlock* first = nullptr;
+        FreeBlock* last = nullptr;
+        for (auto* block = chain; block != nullptr;) {
+            auto* next = block->next;
+            if (freeCounts[poolIndex(block)] != _poolSize) {
+                block->next = first;
+                first = block;
+                if (last == nullptr) {
+                    last = block;
+                }
+            }
+            block = next;
+        }
+
+        uint32_t released = 0;
+        size_t kept = 0;
+        for (size_t i = 0; i < _pools.size(); ++i) {
+            if (freeCounts[i] == _poolSize) {
+                ReleasePool(_pools[i]);
+                ++released;
+            }
+            else {
+                _pools[kept++] = _pools[i];
+            }
+        }
+        _pools.resize(kept);
+
+        _capacity.fetch_sub(released * _poolSize, std::memory_order_relaxed);
+
+        if (first != nullptr) {
+            PushChain(first, last);
+        }
+
+        _trimCapacity.store(capacity(), std::memory_order_relaxed);
+        _trimAllocated.store(FoldedAllocated(), std::memory_order_relaxed);
+
+        return released;
+    }
+
+    void Allocator::PushChain(FreeBlock* first, FreeBlock* last) {
+        auto* head = _freeBlocks.load(std::memory_order_relaxed);
+        do {
+            last->next = head;
+        } while (!_freeBlocks.compare_exchange_weak(head, first, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    uint8_t* Allocator::AcquirePool() {
+        if (_backend == Backend::HugePages) {
+            if (_region == nullptr && _regionUsed == 0) {
+                _region = ReserveRegion(RISE_ALLOCATOR_REGION_SIZE);
+                // don't try to reserve again if the platform refused once
+                _regionUsed = _region == nullptr ? RISE_ALLOCATOR_REGION_SIZE : 0;
+            }
+
+            uint8_t* pool = nullptr;
+            if (!_regionFreeSlots.empty()) {
+                pool = _regionFreeSlots.back();
+                _regionFreeSlots.pop_back();
+            }
+            else if (_region != nullptr && _regionUsed + _poolStride <= RISE_ALLOCATOR_REGION_SIZE) {
+                pool = _region + _regionUsed;
+                _regionUsed += _poolStride;
+            }
+
+            if (pool != nullptr) {
+                if (CommitRange(pool, _poolStride)) {
+                    return pool;
+                }
+                _regionFreeSlots.emplace_back(pool);
+            }
+        }
+
+        return reinterpret_cast<uint8_t*>(::operator new(static_cast<size_t>(_blockSize) * _poolSize));
+    }
+
+    void Allocator::ReleasePool(uint8_t* pool) {
+        if (_region != nullptr && pool >= _region && pool < _region + RISE_ALLOCATOR_REGION_SIZE) {
+            DecommitRange(pool, _poolStride);
+            _regionFreeSlots.emplace_back(pool);
+            return;
+        }
+
+        ::operator delete(pool);
+    }
+
+    Allocator::FreeBlock* Allocator::CreatePool() {
+        uint8_t* pool;
+        {
+            std::lock_guard<std::mutex> lg(_poolLock);
+            pool = AcquirePool();
+            _pools.insert(std::upper_bound(_pools.begin(), _pools.end(), pool), pool);
+        }
+
+        for (size_t i = 0; i + 1 < _poolSize; ++i) {
+            reinterpret_cast<FreeBlock*>(pool + _blockSize * i)->next = reinterpret_cast<FreeBlock*>(pool + _blockSize * (i + 1));
+        }
+        reinterpret_cast<FreeBlock*>(pool + _blockSize * (_poolSize - 1))->next = nullptr;
+
+        _capacity.fetch_add(_poolSize, std::memory_order_relaxed);
+
+        return reinterpret_cast<FreeBlock*>(pool);
     }
 }
@@ -10,7 +10,12 @@
 
 namespace Rise {
 
-    void Font::LoadFromFile(const std::string& filename) {
+    void Font::LoadFromFile(const std::string& filename, const CancellationToken& token) {
+        if (token.IsCancelled()) {
+            MarkCancelled();
+            return;
+        }
+
         FT_Face face;
         static auto load_flags = FT_LOAD_DEFAULT;
         static auto render_mode = FT_RENDER_MODE_NORMAL;
@@ -59,6 +64,17 @@ namespace Rise {
         std::vector<stbrp_rect> rects(face->num_glyphs);
 
         for (auto glyph_index = 0; glyph_index < face->num_glyphs; ++glyph_index) {
+            // rendering every glyph is the long part
+            if (token.IsCancelled()) {
+                for (auto i = 0; i < glyph_index; ++i) {
+                    FT_Done_Glyph(reinterpret_cast<FT_Glyph>(ftGlyphs[i]));
+                }
+                FT_Done_Face(face);
+                _glyphs.clear();
+                MarkCancelled();
+                return;
+            }
+
             {/* load glyph image into the slot (erase previous one) */
                 auto error = FT_Load_Glyph(face, glyph_index, FT_LOAD_DEFAULT);
                 if (error)
@@ -116,9 +132,25 @@ namespace Rise {
         auto customAtlas = Instance()->Resources().CreateRes<CustomImage>(&_atlasMeta);
         _glyphAtlas = customAtlas;
 
+        // gives up once the atlas has failed
+        auto fail = [&](const std::string& message) {
+            for (auto& ftGlyph : ftGlyphs) {
+                FT_Done_Glyph(reinterpret_cast<FT_Glyph>(ftGlyph));
+            }
+            FT_Done_Face(face);
+            _glyphs.clear();
+            _glyphAtlas.reset();
+            Error(message);
+            MarkFailed();
+        };
+
         constexpr auto pixelSize = 1;
         auto imageDataPtr = customAtlas->LoadPrepare(pixelSize);
         uint8_t* data = reinterpret_cast<uint8_t*>(imageDataPtr.ptr());
+        if (data == nullptr) {
+            fail("couldn't prepare glyph atlas!");
+            return;
+        }
         auto bufferSize = textureSize * textureSize * pixelSize;
 
         for (auto i = 0u; i < bufferSize; ++i) {
@@ -150,7 +182,10 @@ namespace Rise {
             }
         }
 
-        customAtlas->LoadCommit(pixelSize);
+        if (!customAtlas->LoadCommit(pixelSize)) {
+            fail("couldn't upload glyph atlas!");
+            return;
+        }
 
         FT_ULong  charcode;
         FT_UInt   gindex;
@@ -197,7 +232,7 @@ namespace Rise {
     }
 
     void Draw::drawText(Draw::Context context, const std::string& text, const Point2D& point, std::shared_ptr<Font> font, uint32_t size, const ColorRGB& color) {
-        if (!font->IsLoaded()) {
+        if (!font->Touch()) {
             return;
         }
 
@@ -3,46 +3,124 @@
 
 #include "Rise/rise.h"
 #include "Rise/logger.h"
+#include "Rise/upload_queue.h"
+
+#include <json/json.hpp>
+
+#include <algorithm>
 
 namespace Rise {
 
+    namespace {
+
+        VkImageCreateInfo ImageCreateInfo(const VkExtent3D& extent, VkFormat format, VkImageUsageFlags usage) {
+            VkImageCreateInfo imageInfo{};
+            imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+            imageInfo.imageType = VK_IMAGE_TYPE_2D;
+            imageInfo.extent = extent;
+            imageInfo.mipLevels = 1;
+            imageInfo.arrayLayers = 1;
+            imageInfo.format = format;
+            imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+            imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            imageInfo.usage = usage;
+            imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+            imageInfo.flags = 0; // Optional
+            return imageInfo;
+        }
+
+    }
+
     std::unordered_map<uint32_t, GpuAllocator::MemoryData> GpuAllocator::_memoryByType;
 
     std::unordered_map<VkBuffer, GpuAllocator::AllocationData> GpuAllocator::_bufferAllocations;
     std::unordered_map<VkImage, GpuAllocator::AllocationData> GpuAllocator::_imageAllocations;
 
+    std::unordered_map<VkBuffer, GpuAllocator::Relocation<GpuAllocator::BufferMoved>> GpuAllocator::_bufferRelocations;
+    std::unordered_map<VkImage, GpuAllocator::Relocation<GpuAllocator::ImageMoved>> GpuAllocator::_imageRelocations;
+
+    std::unordered_map<VkBuffer, VkBuffer> GpuAllocator::_bufferMoves;
+    std::unordered_map<VkImage, VkImage> GpuAllocator::_imageMoves;
+
+    GpuAllocator::Config GpuAllocator::_config;
+
+    GpuAllocator::Drain GpuAllocator::_drain;
+    uint64_t GpuAllocator::_nextDrainSearch = 0;
+
+    std::vector<GpuAllocator::Retired> GpuAllocator::_retired;
+
+    std::vector<GpuAllocator::HeapBudget> GpuAllocator::_budgets;
+    std::vector<uint64_t> GpuAllocator::_nextPressureFrame;
+
+    std::unordered_map<uint32_t, GpuAllocator::PressureCallback> GpuAllocator::_pressureCallbacks;
+    uint32_t GpuAllocator::_nextPressureCallbackId = 0;
+
     std::shared_mutex GpuAllocator::_allocationLock;
 
-    GpuAllocator::Buffer::MapPtr GpuAllocator::Buffer::MapMemory() const {
-        std::unique_lock ul(_allocationLock);
-        auto& allocation = _bufferAllocations[_vBuffer];
-        auto& memoryByType = _memoryByType.find(allocation.memoryType)->second;
-        return memoryByType._memoryBlocks[allocation.blockIndex].MapMemory(allocation.offset);
+    void GpuAllocator::Buffer::Flush(VkDeviceSize offset, VkDeviceSize size) const {
+        if (_coherent) {
+            return;
+        }
+
+        VkMappedMemoryRange range;
+        {
+            std::shared_lock sl(_allocationLock);
+            range = MappedRange(_vBuffer, offset, size);
+        }
+
+        std::lock_guard<std::recursive_mutex> lg(Instance()->_deviceLock);
+        vkFlushMappedMemoryRanges(Instance()->_vDevice, 1, &range);
     }
 
-    GpuAllocator::Buffer::MapPtr::~MapPtr() {
-        std::lock_guard<std::recursive_mutex> lg(Rise::Instance()->_deviceLock);
+    void GpuAllocator::Buffer::Invalidate(VkDeviceSize offset, VkDeviceSize size) const {
+        if (_coherent) {
+            return;
+        }
+
+        VkMappedMemoryRange range;
+        {
+            std::shared_lock sl(_allocationLock);
+            range = MappedRange(_vBuffer, offset, size);
+        }
+
+        std::lock_guard<std::recursive_mutex> lg(Instance()->_deviceLock);
+        vkInvalidateMappedMemoryRanges(Instance()->_vDevice, 1, &range);
     }
 
-    GpuAllocator::Buffer::MapPtr GpuAllocator::MemoryData::MemoryBlock::MapMemory(ptrdiff_t offset) {
-        auto mapPtr = _mapPtr.lock();
-        if (!mapPtr) {
-            void* pData;
-            {
-                std::lock_guard<std::recursive_mutex> lg(Rise::Instance()->_deviceLock);
-                vkMapMemory(Instance()->_vDevice, _vMemory, 0, _size, 0, &pData);
-            }
+    VkMappedMemoryRange GpuAllocator::MappedRange(VkBuffer vBuffer, VkDeviceSize offset, VkDeviceSize size) {
+        const auto& data = _bufferAllocations.find(vBuffer)->second;
+        const auto& memoryBlock = _memoryByType.find(data.memoryType)->second._memoryBlocks[data.blockIndex];
 
-            mapPtr = { pData, [vMemory = this->_vMemory](void*) {
-                vkUnmapMemory(Instance()->_vDevice, vMemory);
-            } };
-            _mapPtr = mapPtr;
+        if (size == VK_WHOLE_SIZE || offset + size > data.bufferSize) {
+            size = data.bufferSize - std::min(offset, data.bufferSize);
         }
-        return { mapPtr, offset };
+
+        auto atomSize = Instance()->_vPhysicalDeviceProperties.limits.nonCoherentAtomSize;
+        auto begin = (data.offset + offset) / atomSize * atomSize;
+        auto end = std::min((data.offset + offset + size + atomSize - 1) / atomSize * atomSize, memoryBlock._size);
+
+        VkMappedMemoryRange range{};
+        range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+        range.memory = memoryBlock._vMemory;
+        range.offset = begin;
+        range.size = end - begin;
+        return range;
+    }
+
+    GpuAllocator::Buffer GpuAllocator::MakeBuffer(VkBuffer vBuffer, const AllocationData& data) {
+        const auto& memoryBlock = _memoryByType.find(data.memoryType)->second._memoryBlocks[data.blockIndex];
+        auto* mapped = memoryBlock._mapped != nullptr ? reinterpret_cast<uint8_t*>(memoryBlock._mapped) + data.offset : nullptr;
+        auto coherent = (Instance()->_vMemoryProperties.memoryTypes[data.memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+        return Buffer(vBuffer, mapped, coherent);
     }
 
     // TODO change vulkan flags to "Gpu/Gpu-Cpu/Cpu" enum and support using more fast one, if requested is inaccessible
     GpuAllocator::Buffer GpuAllocator::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkMemoryPropertyFlags ignoreProperties) {
+        return CreateBufferOfTypes(size, usage, properties, ignoreProperties, ~0u);
+    }
+
+    GpuAllocator::Buffer GpuAllocator::CreateBufferOfTypes(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkMemoryPropertyFlags ignoreProperties, uint32_t memoryTypes) {
         VkBuffer buffer;
 
         VkBufferCreateInfo bufferInfo{};
@@ -55,128 +133,198 @@ namespace Rise {
             std::lock_guard<std::recursive_mutex> lg(Instance()->_deviceLock);
             if (vkCreateBuffer(Instance()->_vDevice, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
                 Instance()->Logger().Error("failed to create buffer!");
+                return Buffer();
             }
         }
 
-        VkMemoryRequirements memRequirements;
-        vkGetBufferMemoryRequirements(Instance()->_vDevice, buffer, &memRequirements);
+        VkMemoryDedicatedRequirements dedicatedRequirements{};
+        dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+
+        VkMemoryRequirements2 memRequirements2{};
+        memRequirements2.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+        memRequirements2.pNext = &dedicatedRequirements;
+
+        VkBufferMemoryRequirementsInfo2 requirementsInfo{};
+        requirementsInfo.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2;
+        requirementsInfo.buffer = buffer;
+
+        vkGetBufferMemoryRequirements2(Instance()->_vDevice, &requirementsInfo, &memRequirements2);
+        auto& memRequirements = memRequirements2.memoryRequirements;
+
+        // none of the allowed types fits this buffer, the caller has some other way
+        memRequirements.memoryTypeBits &= memoryTypes;
+        if (memRequirements.memoryTypeBits == 0) {
+            std::lock_guard<std::recursive_mutex> lg(Instance()->_deviceLock);
+            vkDestroyBuffer(Instance()->_vDevice, buffer, nullptr);
+            return Buffer();
+        }
+
+        VkMemoryDedicatedAllocateInfo dedicatedInfo{};
+        dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+        dedicatedInfo.buffer = buffer;
 
         VkDeviceMemory memory;
         std::unique_lock ul(_allocationLock);
+        // reads the config, so not before the lock
+        auto* pDedicatedInfo = ShouldBeDedicated(memRequirements, dedicatedRequirements) ? &dedicatedInfo : nullptr;
         auto& allocationData = _bufferAllocations.try_emplace(buffer).first->second;
-        Allocate(memRequirements, properties, ignoreProperties, memory, allocationData);
+        if (!Allocate(memRequirements, properties, ignoreProperties, pDedicatedInfo, memory, allocationData)) {
+            _bufferAllocations.erase(buffer);
+            std::lock_guard<std::recursive_mutex> lg(Instance()->_deviceLock);
+            vkDestroyBuffer(Instance()->_vDevice, buffer, nullptr);
+            return Buffer();
+        }
+
+        allocationData.usage = usage;
+        allocationData.bufferSize = size;
 
         {
             std::lock_guard<std::recursive_mutex> lg(Instance()->_deviceLock);
             vkBindBufferMemory(Instance()->_vDevice, buffer, memory, allocationData.offset);
         }
 
-        return Buffer(buffer);
+        return MakeBuffer(buffer, allocationData);
     }
 
-    void GpuAllocator::DestroyBuffer(Buffer buffer) {
-        std::unique_lock ul(_allocationLock);
+    GpuAllocator::Buffer GpuAllocator::CreateDirectWriteBuffer(VkDeviceSize size, VkBufferUsageFlags usage) {
+        uint32_t memoryTypes = 0;
         {
-            std::lock_guard<std::recursive_mutex> lg(Instance()->_deviceLock);
-            vkDestroyBuffer(Instance()->_vDevice, buffer._vBuffer, nullptr);
+            std::shared_lock sl(_allocationLock);
+            if (!DirectWriteAvailable(memoryTypes)) {
+                return Buffer();
+            }
         }
 
-        auto allocationIt = _bufferAllocations.find(buffer._vBuffer);
-        auto& allocation = allocationIt->second;
-        auto& memory = _memoryByType.find(allocation.memoryType)->second;
-        auto& block = memory._memoryBlocks[allocation.blockIndex];
-        memory._logicalBlocks.emplace(allocation.blockIndex, allocation.offset, allocation.size);
-        block._blocks.emplace(allocation.offset, allocation.size);
+        // the first device local and host visible type may well be on the small heap that was turned down
+        return CreateBufferOfTypes(size, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, 0, memoryTypes);
+    }
 
-        {
-            auto blockIt = block._blocks.begin();
-            auto nextIt = blockIt;
-            ++nextIt;
-            while (nextIt != block._blocks.end()) {
-                if (blockIt->_offset + blockIt->_size == nextIt->_offset) {
-                    memory._logicalBlocks.erase(
-                        MemoryData::LogicalBlock(allocation.blockIndex, nextIt->_offset, nextIt->_size));
-                    memory._logicalBlocks.erase(
-                        MemoryData::LogicalBlock(allocation.blockIndex, blockIt->_offset, blockIt->_size));
-
-                    blockIt->_size += nextIt->_size;
-                    memory._logicalBlocks.emplace(allocation.blockIndex, blockIt->_offset, blockIt->_size);
-                    nextIt = block._blocks.erase(nextIt);
-                }
-                else {
-                    blockIt = nextIt;
-                    ++nextIt;
+    bool GpuAllocator::DirectWriteAvailable(uint32_t& memoryTypes) {
+        memoryTypes = 0;
+        if (!_config.directWrite) {
+            return false;
+        }
+
+        const auto& memProperties = Instance()->_vMemoryProperties;
+        auto deviceType = Instance()->_vPhysicalDeviceProperties.deviceType;
+        auto unifiedMemory = deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU || deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU;
+
+        constexpr VkMemoryPropertyFlags directWriteFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+        for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+            if ((memProperties.memoryTypes[i].propertyFlags & directWriteFlags) != directWriteFlags) {
+                continue;
+            }
+
+            auto heap = memProperties.memoryTypes[i].heapIndex;
+            if (!unifiedMemory && memProperties.memoryHeaps[heap].size <= _config.directWriteMinHeapSize) {
+                continue;
+            }
+
+            if (heap < _budgets.size()) {
+                const auto& budget = _budgets[heap];
+                if (budget.usage > static_cast<VkDeviceSize>(budget.budget * _config.pressureThreshold)) {
+                    continue;
                 }
             }
+
+            memoryTypes |= 1u << i;
         }
 
-        _bufferAllocations.erase(allocationIt);
+        return memoryTypes != 0;
     }
 
-    void GpuAllocator::CopyBuffer(Buffer srcBuffer, Buffer dstBuffer, VkDeviceSize size) {
-        VkCommandBufferAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        allocInfo.commandPool = Instance()->_vInstantCommandPool;
-        allocInfo.commandBufferCount = 1;
-
-        VkCommandBuffer commandBuffer;
-        std::lock_guard<std::recursive_mutex> lg(Instance()->_deviceLock);
-        vkAllocateCommandBuffers(Instance()->_vDevice, &allocInfo, &commandBuffer);
+    void GpuAllocator::DestroyBuffer(Buffer buffer) {
+        std::unique_lock ul(_allocationLock);
+        DestroyBufferLocked(buffer._vBuffer);
+    }
 
-        VkCommandBufferBeginInfo beginInfo{};
-        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    void GpuAllocator::DestroyBufferLocked(VkBuffer vBuffer) {
+        _bufferRelocations.erase(vBuffer);
 
-        vkBeginCommandBuffer(commandBuffer, &beginInfo);
+        auto allocationIt = _bufferAllocations.find(vBuffer);
+        if (allocationIt == _bufferAllocations.end()) {
+            return;
+        }
 
-        VkBufferCopy copyRegion{};
-        copyRegion.srcOffset = 0;
-        copyRegion.dstOffset = 0;
-        copyRegion.size = size;
-        vkCmdCopyBuffer(commandBuffer, srcBuffer._vBuffer, dstBuffer._vBuffer, 1, &copyRegion);
+        if (!allocationIt->second.moving) {
+            ReleaseBuffer(vBuffer);
+            return;
+        }
 
-        vkEndCommandBuffer(commandBuffer);
+        if (allocationIt->second.destroyed) {
+            return;
+        }
+        // still being copied from, FinishMove retires it together with the copy
+        allocationIt->second.destroyed = true;
+
+        // or the copy has been handed over already, then the owner let go of it as well
+        auto moveIt = _bufferMoves.find(vBuffer);
+        if (moveIt != _bufferMoves.end()) {
+            auto moved = moveIt->second;
+            _bufferMoves.erase(moveIt);
+            DestroyBufferLocked(moved);
+        }
+    }
 
-        VkSubmitInfo submitInfo{};
-        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-        submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &commandBuffer;
+    void GpuAllocator::ReleaseBuffer(VkBuffer vBuffer) {
+        {
+            std::lock_guard<std::recursive_mutex> lg(Instance()->_deviceLock);
+            vkDestroyBuffer(Instance()->_vDevice, vBuffer, nullptr);
+        }
 
-        vkQueueSubmit(Instance()->_vGraphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-        vkQueueWaitIdle(Instance()->_vGraphicsQueue);
+        auto allocationIt = _bufferAllocations.find(vBuffer);
+        Free(allocationIt->second);
 
-        vkFreeCommandBuffers(Instance()->_vDevice, Instance()->_vInstantCommandPool, 1, &commandBuffer);
+        _bufferAllocations.erase(allocationIt);
+        _bufferMoves.erase(vBuffer);
     }
 
     GpuAllocator::Image GpuAllocator::CreateImage(VkExtent3D& extent, VkFormat format, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkMemoryPropertyFlags ignoreProperties /* = 0*/) {
         VkImage image;
 
-        VkImageCreateInfo imageInfo{};
-        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-        imageInfo.imageType = VK_IMAGE_TYPE_2D;
-        imageInfo.extent = extent;
-        imageInfo.mipLevels = 1;
-        imageInfo.arrayLayers = 1;
-        imageInfo.format = format;
-        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        imageInfo.usage = usage;
-        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-        imageInfo.flags = 0; // Optional
+        auto imageInfo = ImageCreateInfo(extent, format, usage);
 
-        if (vkCreateImage(Instance()->_vDevice, &imageInfo, nullptr, &image) != VK_SUCCESS) {
-            Instance()->Logger().Error("failed to create image!");
+        {
+            std::lock_guard<std::recursive_mutex> lg(Instance()->_deviceLock);
+            if (vkCreateImage(Instance()->_vDevice, &imageInfo, nullptr, &image) != VK_SUCCESS) {
+                Instance()->Logger().Error("failed to create image!");
+                return Image();
+            }
         }
 
-        VkMemoryRequirements memRequirements;
-        vkGetImageMemoryRequirements(Instance()->_vDevice, image, &memRequirements);
+        VkMemoryDedicatedRequirements dedicatedRequirements{};
+        dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+
+        VkMemoryRequirements2 memRequirements2{};
+        memRequirements2.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+        memRequirements2.pNext = &dedicatedRequirements;
+
+        VkImageMemoryRequirementsInfo2 requirementsInfo{};
+        requirementsInfo.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
+        requirementsInfo.image = image;
+
+        vkGetImageMemoryRequirements2(Instance()->_vDevice, &requirementsInfo, &memRequirements2);
+        const auto& memRequirements = memRequirements2.memoryRequirements;
+
+        VkMemoryDedicatedAllocateInfo dedicatedInfo{};
+        dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+        dedicatedInfo.image = image;
 
         VkDeviceMemory memory;
         std::unique_lock ul(_allocationLock);
+        // reads the config, so not before the lock
+        auto* pDedicatedInfo = ShouldBeDedicated(memRequirements, dedicatedRequirements) ? &dedicatedInfo : nullptr;
         auto& allocationData = _imageAllocations.try_emplace(image).first->second;
-        Allocate(memRequirements, properties, ignoreProperties, memory, allocationData);
+        if (!Allocate(memRequirements, properties, ignoreProperties, pDedicatedInfo, memory, allocationData)) {
+            _imageAllocations.erase(image);
+            std::lock_guard<std::recursive_mutex> lg(Instance()->_deviceLock);
+            vkDestroyImage(Instance()->_vDevice, image, nullptr);
+            return Image();
+        }
+
+        allocationData.usage = usage;
+        allocationData.extent = extent;
+        allocationData.format = format;
 
         {
             std::lock_guard<std::recursive_mutex> lg(Instance()->_deviceLock);
@@ -187,131 +335,592 @@ namespace Rise {
     }
     void GpuAllocator::DestroyImage(GpuAllocator::Image image) {
         std::unique_lock ul(_allocationLock);
+        DestroyImageLocked(image._vImage);
+    }
+
+    void GpuAllocator::DestroyImageLocked(VkImage vImage) {
+        _imageRelocations.erase(vImage);
+
+        auto allocationIt = _imageAllocations.find(vImage);
+        if (allocationIt == _imageAllocations.end()) {
+            return;
+        }
+
+        if (!allocationIt->second.moving) {
+            ReleaseImage(vImage);
+            return;
+        }
+
+        if (allocationIt->second.destroyed) {
+            return;
+        }
+        // still being copied from, FinishMove retires it together with the copy
+        allocationIt->second.destroyed = true;
+
+        // or the copy has been handed over already, then the owner let go of it as well
+        auto moveIt = _imageMoves.find(vImage);
+        if (moveIt != _imageMoves.end()) {
+            auto moved = moveIt->second;
+            _imageMoves.erase(moveIt);
+            DestroyImageLocked(moved);
+        }
+    }
+
+    void GpuAllocator::ReleaseImage(VkImage vImage) {
         {
             std::lock_guard<std::recursive_mutex> lg(Instance()->_deviceLock);
-            vkDestroyImage(Instance()->_vDevice, image._vImage, nullptr);
+            vkDestroyImage(Instance()->_vDevice, vImage, nullptr);
         }
 
+        auto allocationIt = _imageAllocations.find(vImage);
+        Free(allocationIt->second);
+
+        _imageAllocations.erase(allocationIt);
+        _imageMoves.erase(vImage);
+    }
+
+    std::shared_ptr<GpuAllocator::RelocationGuard> GpuAllocator::SetRelocatable(Buffer buffer, BufferMoved onMoved) {
+        std::unique_lock ul(_allocationLock);
+        auto allocationIt = _bufferAllocations.find(buffer._vBuffer);
+        if (allocationIt == _bufferAllocations.end()) {
+            return nullptr;
+        }
+
+        constexpr VkBufferUsageFlags transferUsage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        if ((allocationIt->second.usage & transferUsage) != transferUsage) {
+            Instance()->Logger().Error("relocatable buffer has to be usable as transfer source and destination!");
+            return nullptr;
+        }
+
+        auto guard = std::make_shared<RelocationGuard>();
+        _bufferRelocations[buffer._vBuffer] = { std::move(onMoved), guard };
+        return guard;
+    }
+
+    std::shared_ptr<GpuAllocator::RelocationGuard> GpuAllocator::SetRelocatable(Image image, ImageMoved onMoved) {
+        std::unique_lock ul(_allocationLock);
         auto allocationIt = _imageAllocations.find(image._vImage);
-        auto& allocation = allocationIt->second;
-        auto& memory = _memoryByType.find(allocation.memoryType)->second;
-        auto& block = memory._memoryBlocks[allocation.blockIndex];
-        memory._logicalBlocks.emplace(allocation.blockIndex, allocation.offset, allocation.size);
-        block._blocks.emplace(allocation.offset, allocation.size);
+        if (allocationIt == _imageAllocations.end()) {
+            return nullptr;
+        }
+
+        constexpr VkImageUsageFlags transferUsage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        if ((allocationIt->second.usage & transferUsage) != transferUsage) {
+            Instance()->Logger().Error("relocatable image has to be usable as transfer source and destination!");
+            return nullptr;
+        }
+
+        auto guard = std::make_shared<RelocationGuard>();
+        _imageRelocations[image._vImage] = { std::move(onMoved), guard };
+        return guard;
+    }
 
+    void GpuAllocator::Retire(std::function<void()> destroy) {
+        std::unique_lock ul(_allocationLock);
+        _retired.push_back({ Instance()->_globalFrameCounter + _config.retireFrames, std::move(destroy) });
+    }
+
+    void GpuAllocator::SetConfig(const Config& config) {
+        std::unique_lock ul(_allocationLock);
+        _config = config;
+
+        _config.minBlockSize = std::max<VkDeviceSize>(_config.minBlockSize, 1);
+        _config.maxBlockSize = std::max(_config.maxBlockSize, _config.minBlockSize);
+        _config.dedicatedThreshold = std::min(_config.dedicatedThreshold, _config.maxBlockSize);
+
+        for (auto& [memoryType, memoryData] : _memoryByType) {
+            memoryData._nextBlockSize = std::clamp(memoryData._nextBlockSize, _config.minBlockSize, _config.maxBlockSize);
+        }
+    }
+
+    GpuAllocator::Config GpuAllocator::config() {
+        std::shared_lock sl(_allocationLock);
+        return _config;
+    }
+
+    void GpuAllocator::Update() {
+        auto frame = Instance()->_globalFrameCounter;
+
+        std::vector<Retired> due;
+        {
+            std::unique_lock ul(_allocationLock);
+            auto dueIt = std::partition(_retired.begin(), _retired.end(), [frame](const Retired& retired) {
+                return retired.frame > frame;
+            });
+            std::move(dueIt, _retired.end(), std::back_inserter(due));
+            _retired.erase(dueIt, _retired.end());
+        }
+        for (auto& retired : due) {
+            retired.destroy();
+        }
+
+        std::vector<std::pair<uint32_t, VkDeviceSize>> pressure;
+        std::vector<PressureCallback> callbacks;
         {
-            auto blockIt = block._blocks.begin();
-            auto nextIt = blockIt;
-            ++nextIt;
-            while (nextIt != block._blocks.end()) {
-                if (blockIt->_offset + blockIt->_size == nextIt->_offset) {
-                    memory._logicalBlocks.erase(
-                        MemoryData::LogicalBlock(allocation.blockIndex, nextIt->_offset, nextIt->_size));
-                    memory._logicalBlocks.erase(
-                        MemoryData::LogicalBlock(allocation.blockIndex, blockIt->_offset, blockIt->_size));
-
-                    blockIt->_size += nextIt->_size;
-                    memory._logicalBlocks.emplace(allocation.blockIndex, blockIt->_offset, blockIt->_size);
-                    nextIt = block._blocks.erase(nextIt);
+            std::unique_lock ul(_allocationLock);
+            for (auto& [memoryType, memoryData] : _memoryByType) {
+                memoryData.ReleaseEmptyBlocks(frame);
+            }
+
+            UpdateBudgets();
+            pressure = CheckPressure(frame);
+            if (!pressure.empty()) {
+                for (const auto& [id, callback] : _pressureCallbacks) {
+                    callbacks.emplace_back(callback);
                 }
-                else {
-                    blockIt = nextIt;
-                    ++nextIt;
+            }
+
+            if (!_drain.active && frame >= _nextDrainSearch) {
+                _nextDrainSearch = frame + _config.defragInterval;
+                PickDrain();
+            }
+
+            if (_drain.active) {
+                DrainStep();
+            }
+        }
+
+        for (const auto& [heap, bytes] : pressure) {
+            Instance()->Logger().Warning("gpu memory heap " + std::to_string(heap) + " is close to its budget");
+            for (auto& callback : callbacks) {
+                callback(heap, bytes);
+            }
+        }
+    }
+
+    std::vector<GpuAllocator::HeapBudget> GpuAllocator::budgets() {
+        std::shared_lock sl(_allocationLock);
+        return _budgets;
+    }
+
+    uint32_t GpuAllocator::AddPressureCallback(PressureCallback callback) {
+        std::unique_lock ul(_allocationLock);
+        auto id = _nextPressureCallbackId++;
+        _pressureCallbacks.emplace(id, std::move(callback));
+        return id;
+    }
+
+    void GpuAllocator::RemovePressureCallback(uint32_t id) {
+        std::unique_lock ul(_allocationLock);
+        _pressureCallbacks.erase(id);
+    }
+
+    bool GpuAllocator::AllocateDeviceMemory(const VkMemoryAllocateInfo& allocInfo, VkDeviceMemory& vMemory) {
+        {
+            std::lock_guard<std::recursive_mutex> lg(Instance()->_deviceLock);
+            if (vkAllocateMemory(Instance()->_vDevice, &allocInfo, nullptr, &vMemory) != VK_SUCCESS) {
+                return false;
+            }
+        }
+
+        if (_budgets.empty()) {
+            UpdateBudgets();
+        }
+        auto heap = Instance()->_vMemoryProperties.memoryTypes[allocInfo.memoryTypeIndex].heapIndex;
+        _budgets[heap].allocated += allocInfo.allocationSize;
+        return true;
+    }
+
+    void GpuAllocator::FreeDeviceMemory(VkDeviceMemory vMemory, VkDeviceSize size, uint32_t memoryType) {
+        {
+            std::lock_guard<std::recursive_mutex> lg(Instance()->_deviceLock);
+            vkFreeMemory(Instance()->_vDevice, vMemory, nullptr);
+        }
+
+        auto heap = Instance()->_vMemoryProperties.memoryTypes[memoryType].heapIndex;
+        _budgets[heap].allocated -= size;
+    }
+
+    void GpuAllocator::UpdateBudgets() {
+        const auto& memProperties = Instance()->_vMemoryProperties;
+        if (_budgets.empty()) {
+            _budgets.resize(memProperties.memoryHeapCount);
+            _nextPressureFrame.resize(memProperties.memoryHeapCount, 0);
+            for (uint32_t heap = 0; heap < memProperties.memoryHeapCount; ++heap) {
+                _budgets[heap].heap = heap;
+                _budgets[heap].size = memProperties.memoryHeaps[heap].size;
+            }
+        }
+
+        if (!Instance()->_memoryBudgetSupported) {
+            // drivers tend to report more than is actually usable
+            for (auto& budget : _budgets) {
+                budget.budget = budget.size / 5 * 4;
+                budget.usage = budget.allocated;
+            }
+            return;
+        }
+
+        VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{};
+        budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+        VkPhysicalDeviceMemoryProperties2 memProperties2{};
+        memProperties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+        memProperties2.pNext = &budgetProperties;
+
+        vkGetPhysicalDeviceMemoryProperties2(Instance()->_vPhysicalDevice, &memProperties2);
+
+        for (auto& budget : _budgets) {
+            budget.budget = budgetProperties.heapBudget[budget.heap];
+            budget.usage = budgetProperties.heapUsage[budget.heap];
+        }
+    }
+
+    std::vector<std::pair<uint32_t, VkDeviceSize>> GpuAllocator::CheckPressure(uint64_t frame) {
+        std::vector<std::pair<uint32_t, VkDeviceSize>> pressure;
+        for (const auto& budget : _budgets) {
+            auto threshold = static_cast<VkDeviceSize>(budget.budget * _config.pressureThreshold);
+            if (budget.usage <= threshold || frame < _nextPressureFrame[budget.heap]) {
+                continue;
+            }
+
+            _nextPressureFrame[budget.heap] = frame + _config.pressureInterval;
+            pressure.emplace_back(budget.heap, budget.usage - threshold);
+        }
+        return pressure;
+    }
+
+    bool GpuAllocator::PickDrain() {
+        struct BlockUse {
+            uint32_t allocations = 0;
+            uint32_t relocatable = 0;
+        };
+
+        auto blockKey = [](const AllocationData& data) {
+            return (uint64_t(data.memoryType) << 32) | data.blockIndex;
+        };
+
+        std::unordered_map<uint64_t, BlockUse> blockUses;
+        for (const auto& [vBuffer, data] : _bufferAllocations) {
+            auto& blockUse = blockUses[blockKey(data)];
+            ++blockUse.allocations;
+            if (!data.moving && _bufferRelocations.count(vBuffer) > 0) {
+                ++blockUse.relocatable;
+            }
+        }
+        for (const auto& [vImage, data] : _imageAllocations) {
+            auto& blockUse = blockUses[blockKey(data)];
+            ++blockUse.allocations;
+            if (!data.moving && _imageRelocations.count(vImage) > 0) {
+                ++blockUse.relocatable;
+            }
+        }
+
+        float bestUsage = _config.defragUsage;
+        Drain best;
+
+        for (const auto& [memoryType, memoryData] : _memoryByType) {
+            const auto& tlsf = memoryData._tlsf;
+
+            VkDeviceSize freeBytes = 0;
+            for (uint32_t region = 0; region < tlsf.regionCount(); ++region) {
+                if (tlsf.regionActive(region)) {
+                    freeBytes += tlsf.regionSize(region) - tlsf.regionUsed(region);
+                }
+            }
+
+            for (uint32_t region = 0; region < tlsf.regionCount(); ++region) {
+                if (!tlsf.regionActive(region) || tlsf.regionUsed(region) == 0) {
+                    continue;
+                }
+
+                auto size = tlsf.regionSize(region);
+                auto used = tlsf.regionUsed(region);
+                auto usage = static_cast<float>(used) / static_cast<float>(size);
+                if (usage >= bestUsage) {
+                    continue;
                 }
+
+                // the rest of the blocks has to take everything in, alignment may still make it fail later
+                if (freeBytes - (size - used) < used) {
+                    continue;
+                }
+
+                AllocationData key;
+                key.memoryType = memoryType;
+                key.blockIndex = memoryData._blockByRegion[region];
+                auto& blockUse = blockUses[blockKey(key)];
+                if (blockUse.relocatable != blockUse.allocations) {
+                    continue;
+                }
+
+                bestUsage = usage;
+                best = { true, memoryType, region };
             }
         }
 
-        _imageAllocations.erase(allocationIt);
+        if (!best.active) {
+            return false;
+        }
+
+        _drain = best;
+        _memoryByType.find(_drain.memoryType)->second._tlsf.LockRegion(_drain.region);
+        return true;
+    }
+
+    void GpuAllocator::StopDrain() {
+        if (!_drain.active) {
+            return;
+        }
+
+        _memoryByType.find(_drain.memoryType)->second._tlsf.UnlockRegion(_drain.region);
+        _drain = {};
+    }
+
+    void GpuAllocator::DrainStep() {
+        auto& memoryData = _memoryByType.find(_drain.memoryType)->second;
+        if (memoryData._tlsf.regionUsed(_drain.region) == 0) {
+            memoryData.ReleaseMemoryBlock(_drain.region);
+            _drain = {};
+            return;
+        }
+
+        auto blockIndex = memoryData._blockByRegion[_drain.region];
+        auto inDrain = [memoryType = _drain.memoryType, blockIndex](const AllocationData& data) {
+            return data.memoryType == memoryType && data.blockIndex == blockIndex;
+        };
+
+        bool pending = false;
+        std::vector<VkBuffer> buffers;
+        std::vector<VkImage> images;
+
+        for (const auto& [vBuffer, data] : _bufferAllocations) {
+            if (!inDrain(data)) {
+                continue;
+            }
+            if (data.moving) {
+                pending = true;
+            }
+            else if (_bufferRelocations.count(vBuffer) > 0) {
+                buffers.emplace_back(vBuffer);
+            }
+            else {
+                // somebody allocated before the block was locked and can't be moved
+                StopDrain();
+                return;
+            }
+        }
+        for (const auto& [vImage, data] : _imageAllocations) {
+            if (!inDrain(data)) {
+                continue;
+            }
+            if (data.moving) {
+                pending = true;
+            }
+            else if (_imageRelocations.count(vImage) > 0) {
+                images.emplace_back(vImage);
+            }
+            else {
+                StopDrain();
+                return;
+            }
+        }
+
+        if (!pending && buffers.empty() && images.empty()) {
+            StopDrain();
+            return;
+        }
+
+        uint32_t moves = 0;
+        for (auto vBuffer : buffers) {
+            if (moves++ == _config.defragMoves) {
+                return;
+            }
+            if (!MoveBuffer(vBuffer)) {
+                StopDrain();
+                return;
+            }
+        }
+        for (auto vImage : images) {
+            if (moves++ == _config.defragMoves) {
+                return;
+            }
+            if (!MoveImage(vImage)) {
+                StopDrain();
+                return;
+            }
+        }
     }
 
-    void GpuAllocator::CopyBufferToImage(Buffer srcBuffer, VkDeviceSize size, Image dstImage, VkExtent3D& extent) {
-        VkCommandBufferAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        allocInfo.commandPool = Instance()->_vInstantCommandPool;
-        allocInfo.commandBufferCount = 1;
+    bool GpuAllocator::MoveBuffer(VkBuffer vBuffer) {
+        auto& data = _bufferAllocations.find(vBuffer)->second;
+
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = data.bufferSize;
+        bufferInfo.usage = data.usage;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-        VkCommandBuffer commandBuffer;
+        VkBuffer newBuffer;
         std::lock_guard<std::recursive_mutex> lg(Instance()->_deviceLock);
-        vkAllocateCommandBuffers(Instance()->_vDevice, &allocInfo, &commandBuffer);
+        if (vkCreateBuffer(Instance()->_vDevice, &bufferInfo, nullptr, &newBuffer) != VK_SUCCESS) {
+            return false;
+        }
 
-        VkCommandBufferBeginInfo beginInfo{};
-        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(Instance()->_vDevice, newBuffer, &memRequirements);
 
-        vkBeginCommandBuffer(commandBuffer, &beginInfo);
+        AllocationData newData;
+        auto& memoryData = _memoryByType.find(data.memoryType)->second;
+        if ((memRequirements.memoryTypeBits & (1u << data.memoryType)) == 0 || !memoryData.Allocate(memRequirements, newData, false)) {
+            vkDestroyBuffer(Instance()->_vDevice, newBuffer, nullptr);
+            return false;
+        }
 
-        ///////////////////////////////////////
+        newData.usage = data.usage;
+        newData.bufferSize = data.bufferSize;
+        newData.owner = data.owner;
 
-        VkImageSubresourceRange range;
-        range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        range.baseMipLevel = 0;
-        range.levelCount = 1;
-        range.baseArrayLayer = 0;
-        range.layerCount = 1;
+        vkBindBufferMemory(Instance()->_vDevice, newBuffer, memoryData._memoryBlocks[newData.blockIndex]._vMemory, newData.offset);
+        _bufferAllocations.emplace(newBuffer, newData);
 
-        VkImageMemoryBarrier imageBarrier_toTransfer = {};
-        imageBarrier_toTransfer.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        data.moving = true;
+        auto oldBuffer = MakeBuffer(vBuffer, data);
+        auto movedBuffer = MakeBuffer(newBuffer, newData);
+        Instance()->Uploads().MoveBuffer(oldBuffer, movedBuffer, data.bufferSize, [oldBuffer, movedBuffer]() {
+            FinishMove(oldBuffer, movedBuffer);
+        });
 
-        imageBarrier_toTransfer.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        imageBarrier_toTransfer.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-        imageBarrier_toTransfer.image = dstImage._vImage;
-        imageBarrier_toTransfer.subresourceRange = range;
+        return true;
+    }
 
-        imageBarrier_toTransfer.srcAccessMask = 0;
-        imageBarrier_toTransfer.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    bool GpuAllocator::MoveImage(VkImage vImage) {
+        auto& data = _imageAllocations.find(vImage)->second;
 
-        //barrier the image into the transfer-receive layout
-        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageBarrier_toTransfer);
+        auto imageInfo = ImageCreateInfo(data.extent, data.format, data.usage);
 
-        ///////////////////////////////////////
+        VkImage newImage;
+        std::lock_guard<std::recursive_mutex> lg(Instance()->_deviceLock);
+        if (vkCreateImage(Instance()->_vDevice, &imageInfo, nullptr, &newImage) != VK_SUCCESS) {
+            return false;
+        }
 
-        VkBufferImageCopy copyRegion = {};
-        copyRegion.bufferOffset = 0;
-        copyRegion.bufferRowLength = 0;
-        copyRegion.bufferImageHeight = 0;
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(Instance()->_vDevice, newImage, &memRequirements);
 
-        copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        copyRegion.imageSubresource.mipLevel = 0;
-        copyRegion.imageSubresource.baseArrayLayer = 0;
-        copyRegion.imageSubresource.layerCount = 1;
-        copyRegion.imageOffset = {};
-        copyRegion.imageExtent = extent;
+        AllocationData newData;
+        auto& memoryData = _memoryByType.find(data.memoryType)->second;
+        if ((memRequirements.memoryTypeBits & (1u << data.memoryType)) == 0 || !memoryData.Allocate(memRequirements, newData, false)) {
+            vkDestroyImage(Instance()->_vDevice, newImage, nullptr);
+            return false;
+        }
 
-        //copy the buffer into the image
-        vkCmdCopyBufferToImage(commandBuffer, srcBuffer._vBuffer, dstImage._vImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
+        newData.usage = data.usage;
+        newData.extent = data.extent;
+        newData.format = data.format;
+        newData.owner = data.owner;
 
-        ///////////////////////////////////////
+        vkBindImageMemory(Instance()->_vDevice, newImage, memoryData._memoryBlocks[newData.blockIndex]._vMemory, newData.offset);
+        _imageAllocations.emplace(newImage, newData);
 
-        VkImageMemoryBarrier imageBarrier_toReadable = imageBarrier_toTransfer;
+        data.moving = true;
+        Instance()->Uploads().MoveImage(Image(vImage), Image(newImage), data.extent, [vImage, newImage]() {
+            FinishMove(Image(vImage), Image(newImage));
+        });
 
-        imageBarrier_toReadable.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-        imageBarrier_toReadable.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        return true;
+    }
 
-        imageBarrier_toReadable.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-        imageBarrier_toReadable.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    void GpuAllocator::FinishMove(Buffer oldBuffer, Buffer newBuffer) {
+        // held through the handover and the callback, so the owner's Revoke() can't slip in between
+        std::shared_ptr<RelocationGuard> guard;
+        {
+            std::shared_lock sl(_allocationLock);
+            auto relocationIt = _bufferRelocations.find(oldBuffer._vBuffer);
+            if (relocationIt != _bufferRelocations.end()) {
+                guard = relocationIt->second.guard;
+            }
+        }
+        std::unique_lock<std::mutex> guardLock;
+        if (guard) {
+            guardLock = std::unique_lock<std::mutex>(guard->_lock);
+        }
 
-        //barrier the image into the shader readable layout
-        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageBarrier_toReadable);
+        BufferMoved onMoved;
+        {
+            std::unique_lock ul(_allocationLock);
+            auto retireFrame = Instance()->_globalFrameCounter + _config.retireFrames;
+
+            auto relocationIt = _bufferRelocations.find(oldBuffer._vBuffer);
+            auto ownerAlive = guard != nullptr && relocationIt != _bufferRelocations.end() && relocationIt->second.guard == guard && guard->_alive;
+            if (_bufferAllocations.find(oldBuffer._vBuffer)->second.destroyed || !ownerAlive) {
+                // the owner is gone, nobody needs the copy either
+                _bufferRelocations.erase(oldBuffer._vBuffer);
+                _retired.push_back({ retireFrame, [vBuffer = newBuffer._vBuffer]() {
+                    std::unique_lock ul(_allocationLock);
+                    ReleaseBuffer(vBuffer);
+                } });
+            }
+            else {
+                onMoved = relocationIt->second.onMoved;
+                auto relocation = std::move(relocationIt->second);
+                _bufferRelocations.erase(relocationIt);
+                _bufferRelocations.emplace(newBuffer._vBuffer, std::move(relocation));
+                _bufferMoves[oldBuffer._vBuffer] = newBuffer._vBuffer;
+            }
 
-        ///////////////////////////////////////
+            _retired.push_back({ retireFrame, [vBuffer = oldBuffer._vBuffer]() {
+                std::unique_lock ul(_allocationLock);
+                ReleaseBuffer(vBuffer);
+            } });
+        }
 
-        vkEndCommandBuffer(commandBuffer);
+        if (onMoved) {
+            onMoved(newBuffer);
+        }
+    }
 
-        VkSubmitInfo submitInfo{};
-        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-        submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &commandBuffer;
+    void GpuAllocator::FinishMove(Image oldImage, Image newImage) {
+        // held through the handover and the callback, so the owner's Revoke() can't slip in between
+        std::shared_ptr<RelocationGuard> guard;
+        {
+            std::shared_lock sl(_allocationLock);
+            auto relocationIt = _imageRelocations.find(oldImage._vImage);
+            if (relocationIt != _imageRelocations.end()) {
+                guard = relocationIt->second.guard;
+            }
+        }
+        std::unique_lock<std::mutex> guardLock;
+        if (guard) {
+            guardLock = std::unique_lock<std::mutex>(guard->_lock);
+        }
+
+        ImageMoved onMoved;
+        {
+            std::unique_lock ul(_allocationLock);
+            auto retireFrame = Instance()->_globalFrameCounter + _config.retireFrames;
+
+            auto relocationIt = _imageRelocations.find(oldImage._vImage);
+            auto ownerAlive = guard != nullptr && relocationIt != _imageRelocations.end() && relocationIt->second.guard == guard && guard->_alive;
+            if (_imageAllocations.find(oldImage._vImage)->second.destroyed || !ownerAlive) {
+                // the owner is gone, nobody needs the copy either
+                _imageRelocations.erase(oldImage._vImage);
+                _retired.push_back({ retireFrame, [vImage = newImage._vImage]() {
+                    std::unique_lock ul(_allocationLock);
+                    ReleaseImage(vImage);
+                } });
+            }
+            else {
+                onMoved = relocationIt->second.onMoved;
+                auto relocation = std::move(relocationIt->second);
+                _imageRelocations.erase(relocationIt);
+                _imageRelocations.emplace(newImage._vImage, std::move(relocation));
+                _imageMoves[oldImage._vImage] = newImage._vImage;
+            }
 
-        vkQueueSubmit(Instance()->_vGraphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-        vkQueueWaitIdle(Instance()->_vGraphicsQueue);
+            _retired.push_back({ retireFrame, [vImage = oldImage._vImage]() {
+                std::unique_lock ul(_allocationLock);
+                ReleaseImage(vImage);
+            } });
+        }
 
-        vkFreeCommandBuffers(Instance()->_vDevice, Instance()->_vInstantCommandPool, 1, &commandBuffer);
+        if (onMoved) {
+            onMoved(newImage);
+        }
     }
 
     bool GpuAllocator::FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties, VkMemoryPropertyFlags ignoreProperties, uint32_t& memoryType) {
-        VkPhysicalDeviceMemoryProperties memProperties;
-        vkGetPhysicalDeviceMemoryProperties(Instance()->_vPhysicalDevice, &memProperties);
+        const auto& memProperties = Instance()->_vMemoryProperties;
 
         for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
             if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties
@@ -324,22 +933,217 @@ namespace Rise {
         return false;
     }
 
+    std::vector<GpuAllocator::Statistics> GpuAllocator::statistics() {
+        std::shared_lock sl(_allocationLock);
+
+        std::vector<Statistics> result;
+        for (const auto& [memoryType, memoryData] : _memoryByType) {
+            auto& statistics = result.emplace_back();
+            statistics.memoryType = memoryType;
+
+            for (uint32_t region = 0; region < memoryData._tlsf.regionCount(); ++region) {
+                if (!memoryData._tlsf.regionActive(region)) {
+                    continue;
+                }
+
+                ++statistics.blockCount;
+                statistics.blockBytes += memoryData._tlsf.regionSize(region);
+                statistics.blockUsedBytes += memoryData._tlsf.regionUsed(region);
+            }
+
+            for (const auto& memoryBlock : memoryData._memoryBlocks) {
+                if (memoryBlock._dedicated && memoryBlock._vMemory != VK_NULL_HANDLE) {
+                    ++statistics.dedicatedCount;
+                    statistics.dedicatedBytes += memoryBlock._size;
+                }
+            }
+        }
+        return result;
+    }
+
+    void GpuAllocator::SetOwner(Buffer buffer, const std::string& owner) {
+        std::unique_lock ul(_allocationLock);
+        auto it = _bufferAllocations.find(buffer._vBuffer);
+        if (it != _bufferAllocations.end()) {
+            it->second.owner = owner;
+        }
+    }
+
+    void GpuAllocator::SetOwner(Image image, const std::string& owner) {
+        std::unique_lock ul(_allocationLock);
+        auto it = _imageAllocations.find(image._vImage);
+        if (it != _imageAllocations.end()) {
+            it->second.owner = owner;
+        }
+    }
+
+    std::vector<GpuAllocator::MemoryTypeReport> GpuAllocator::Report() {
+        std::shared_lock sl(_allocationLock);
+
+        std::vector<MemoryTypeReport> result;
+        // block reports by memory type and block index
+        std::unordered_map<uint64_t, BlockReport*> blocks;
+
+        for (const auto& [memoryType, memoryData] : _memoryByType) {
+            auto& typeReport = result.emplace_back();
+            typeReport.memoryType = memoryType;
+            typeReport.heap = Instance()->_vMemoryProperties.memoryTypes[memoryType].heapIndex;
+            typeReport.properties = Instance()->_vMemoryProperties.memoryTypes[memoryType].propertyFlags;
+
+            for (uint32_t region = 0; region < memoryData._tlsf.regionCount(); ++region) {
+                if (!memoryData._tlsf.regionActive(region)) {
+                    continue;
+                }
+
+                auto& blockReport = typeReport.blocks.emplace_back();
+                blockReport.blockIndex = memoryData._blockByRegion[region];
+                blockReport.size = memoryData._tlsf.regionSize(region);
+                blockReport.usedBytes = memoryData._tlsf.regionUsed(region);
+                blockReport.freeBytes = blockReport.size - blockReport.usedBytes;
+                blockReport.largestFreeRange = memoryData._tlsf.regionLargestFree(region);
+                if (blockReport.freeBytes != 0) {
+                    blockReport.fragmentation = 1.0f - float(blockReport.largestFreeRange) / float(blockReport.freeBytes);
+                }
+            }
+
+            for (uint32_t blockIndex = 0; blockIndex < memoryData._memoryBlocks.size(); ++blockIndex) {
+                const auto& memoryBlock = memoryData._memoryBlocks[blockIndex];
+                if (!memoryBlock._dedicated || memoryBlock._vMemory == VK_NULL_HANDLE) {
+                    continue;
+                }
+
+                auto& blockReport = typeReport.blocks.emplace_back();
+                blockReport.blockIndex = blockIndex;
+                blockReport.dedicated = true;
+                blockReport.size = memoryBlock._size;
+                blockReport.usedBytes = memoryBlock._size;
+            }
+        }
+
+        // the vector doesn't grow anymore
+        for (auto& typeReport : result) {
+            for (auto& blockReport : typeReport.blocks) {
+                blocks.emplace((uint64_t(typeReport.memoryType) << 32) | blockReport.blockIndex, &blockReport);
+            }
+        }
+
+        auto addAllocation = [&blocks](const AllocationData& data, bool image, bool relocatable) {
+            auto it = blocks.find((uint64_t(data.memoryType) << 32) | data.blockIndex);
+            if (it == blocks.end()) {
+                return;
+            }
+
+            auto& allocation = it->second->allocations.emplace_back();
+            allocation.offset = data.offset;
+            allocation.size = data.size;
+            allocation.image = image;
+            allocation.relocatable = relocatable;
+            allocation.owner = data.owner;
+        };
+
+        for (const auto& [vBuffer, data] : _bufferAllocations) {
+            addAllocation(data, false, _bufferRelocations.contains(vBuffer));
+        }
+        for (const auto& [vImage, data] : _imageAllocations) {
+            addAllocation(data, true, _imageRelocations.contains(vImage));
+        }
+
+        for (auto& typeReport : result) {
+            for (auto& blockReport : typeReport.blocks) {
+                std::sort(blockReport.allocations.begin(), blockReport.allocations.end(), [](const AllocationReport& lhs, const AllocationReport& rhs) {
+                    return lhs.offset < rhs.offset;
+                });
+            }
+        }
+
+        return result;
+    }
+
+    std::string GpuAllocator::ReportJson() {
+        nlohmann::json report;
+
+        auto& heaps = report["heaps"] = nlohmann::json::array();
+        for (const auto& budget : budgets()) {
+            heaps.push_back({
+                { "heap", budget.heap },
+                { "size", budget.size },
+                { "budget", budget.budget },
+                { "usage", budget.usage },
+                { "allocated", budget.allocated },
+            });
+        }
+
+        auto& memoryTypes = report["memoryTypes"] = nlohmann::json::array();
+        for (const auto& typeReport : Report()) {
+            auto blocks = nlohmann::json::array();
+            for (const auto& blockReport : typeReport.blocks) {
+                auto allocations = nlohmann::json::array();
+                for (const auto& allocation : blockReport.allocations) {
+                    allocations.push_back({
+                        { "offset", allocation.offset },
+                        { "size", allocation.size },
+                        { "kind", allocation.image ? "image" : "buffer" },
+                        { "relocatable", allocation.relocatable },
+                        { "owner", allocation.owner },
+                    });
+                }
+
+                blocks.push_back({
+                    { "block", blockReport.blockIndex },
+                    { "dedicated", blockReport.dedicated },
+                    { "size", blockReport.size },
+                    { "used", blockReport.usedBytes },
+                    { "free", blockReport.freeBytes },
+                    { "largestFreeRange", blockReport.largestFreeRange },
+                    { "fragmentation", blockReport.fragmentation },
+                    { "allocations", std::move(allocations) },
+                });
+            }
+
+            memoryTypes.push_back({
+                { "memoryType", typeReport.memoryType },
+                { "heap", typeReport.heap },
+                { "properties", typeReport.properties },
+                { "blocks", std::move(blocks) },
+            });
+        }
+
+        return report.dump(2);
+    }
+
     void GpuAllocator::Destroy() {
+        auto retired = std::move(_retired);
+        for (auto& entry : retired) {
+            entry.destroy();
+        }
+
         for (auto& memoryByType : _memoryByType) {
             for (auto& memoryBlock : memoryByType.second._memoryBlocks) {
-                vkFreeMemory(Instance()->_vDevice, memoryBlock._vMemory, nullptr);
+                if (memoryBlock._vMemory != VK_NULL_HANDLE) {
+                    FreeDeviceMemory(memoryBlock._vMemory, memoryBlock._size, memoryByType.first);
+                }
             }
         }
     }
 
-    bool GpuAllocator::Allocate(const VkMemoryRequirements& memRequirements, VkMemoryPropertyFlags properties, VkMemoryPropertyFlags ignoreProperties, VkDeviceMemory& memory, AllocationData& data) {
+    bool GpuAllocator::ShouldBeDedicated(const VkMemoryRequirements& memRequirements, const VkMemoryDedicatedRequirements& dedicatedRequirements) {
+        return dedicatedRequirements.requiresDedicatedAllocation
+            || dedicatedRequirements.prefersDedicatedAllocation
+            || memRequirements.size >= _config.dedicatedThreshold;
+    }
+
+    bool GpuAllocator::Allocate(const VkMemoryRequirements& memRequirements, VkMemoryPropertyFlags properties, VkMemoryPropertyFlags ignoreProperties,
+        const VkMemoryDedicatedAllocateInfo* dedicatedInfo, VkDeviceMemory& memory, AllocationData& data) {
         uint32_t memoryType = 0;
         if (!FindMemoryType(memRequirements.memoryTypeBits, properties, ignoreProperties, memoryType)) {
             Instance()->Logger().Error("failed to find suitable memory type!");
+            return false;
         }
 
         auto& memoryData = _memoryByType.try_emplace(memoryType, memoryType).first->second;
-        auto result = memoryData.Allocate(memRequirements, data);
+        auto result = dedicatedInfo != nullptr
+            ? memoryData.AllocateDedicated(memRequirements, *dedicatedInfo, data)
+            : memoryData.Allocate(memRequirements, data);
 
         if (result) {
             memory = memoryData._memoryBlocks[data.blockIndex]._vMemory;
@@ -347,160 +1151,447 @@ namespace Rise {
         return result;
     }
 
-    bool GpuAllocator::MemoryData::Allocate(const VkMemoryRequirements& memRequirements, AllocationData& data) {
-        if (memRequirements.size > RISE_GPU_ALLOCATOR_BLOCK_SIZE) {
+    void GpuAllocator::Free(const AllocationData& data) {
+        auto it = _memoryByType.find(data.memoryType);
+        if (it == _memoryByType.end()) {
+            return;
+        }
+        it->second.Free(data);
+    }
+
+    bool GpuAllocator::MemoryData::Allocate(const VkMemoryRequirements& memRequirements, AllocationData& data, bool mayGrow) {
+        if (memRequirements.size > _config.maxBlockSize) {
             Instance()->Logger().Error("block size less then requested memory size!");
+            return false;
         }
 
-        // getting smallest block
-        auto it = _logicalBlocks.lower_bound({ memRequirements.size });
+        Tlsf::Allocation allocation;
+        if (!_tlsf.Allocate(memRequirements.size, memRequirements.alignment, allocation)) {
+            // freshly created blocks always fit anything not bigger than a block
+            if (!mayGrow || !CreateMemoryBlock(memRequirements.size) || !_tlsf.Allocate(memRequirements.size, memRequirements.alignment, allocation)) {
+                return false;
+            }
+        }
 
-        // getting alignment into account
-        auto alignMask = memRequirements.alignment - 1;
-        VkDeviceSize offset = 0;
+        data.memoryType = _memoryType;
+        data.blockIndex = _blockByRegion[allocation.region];
+        data.offset = allocation.offset;
+        data.size = allocation.size;
+        data.handle = allocation.handle;
 
-        while (it != _logicalBlocks.end()) {
-            offset = (it->_offset + alignMask) & ~alignMask;
+        return true;
+    }
 
-            // looking for smallest block into which alignment fit
-            if (memRequirements.size <= it->_size - (offset - it->_offset)) {
-                break;
-            }
+    bool GpuAllocator::MemoryData::AllocateDedicated(const VkMemoryRequirements& memRequirements, const VkMemoryDedicatedAllocateInfo& dedicatedInfo, AllocationData& data) {
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.pNext = &dedicatedInfo;
+        allocInfo.allocationSize = memRequirements.size;
+        allocInfo.memoryTypeIndex = _memoryType;
+
+        VkDeviceMemory vMemory;
+        if (!AllocateDeviceMemory(allocInfo, vMemory)) {
+            Instance()->Logger().Error("failed to allocate dedicated memory!");
+            return false;
+        }
+
+        data.memoryType = _memoryType;
+        data.blockIndex = EmplaceMemoryBlock(vMemory, memRequirements.size, true);
+        data.offset = 0;
+        data.size = memRequirements.size;
+        data.handle = Tlsf::InvalidHandle;
+
+        return true;
+    }
 
-            ++it;
+    void GpuAllocator::MemoryData::Free(const AllocationData& data) {
+        auto& memoryBlock = _memoryBlocks[data.blockIndex];
+        if (!memoryBlock._dedicated) {
+            _tlsf.Free(data.handle);
+            return;
         }
 
-        // if there is not, create new block
-        // freshly created blocks always please alignment
-        if (it == _logicalBlocks.end()) {
-            it = CreateMemoryBlock(_memoryType);
-            offset = it->_offset;
+        FreeDeviceMemory(memoryBlock._vMemory, memoryBlock._size, _memoryType);
+        memoryBlock._vMemory = VK_NULL_HANDLE;
+        memoryBlock._size = 0;
+        memoryBlock._mapped = nullptr;
+        _unusedBlocks.emplace_back(data.blockIndex);
+    }
+
+    uint32_t GpuAllocator::MemoryData::EmplaceMemoryBlock(VkDeviceMemory vMemory, VkDeviceSize size, bool dedicated) {
+        uint32_t blockIndex;
+        if (!_unusedBlocks.empty()) {
+            blockIndex = _unusedBlocks.back();
+            _unusedBlocks.pop_back();
+            _memoryBlocks[blockIndex] = MemoryBlock(size);
+        }
+        else {
+            blockIndex = static_cast<uint32_t>(_memoryBlocks.size());
+            _memoryBlocks.emplace_back(size);
         }
 
-        auto& memoryBlock = _memoryBlocks[it->_blockIndex];
-        memoryBlock._blocks.erase(memoryBlock._blocks.find({ it->_offset }));
+        auto& memoryBlock = _memoryBlocks[blockIndex];
+        memoryBlock._vMemory = vMemory;
+        memoryBlock._dedicated = dedicated;
 
-        data.memoryType = _memoryType;
-        data.blockIndex = it->_blockIndex;
-        data.offset = offset;
-        data.size = memRequirements.size;
+        if (Instance()->_vMemoryProperties.memoryTypes[_memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+            std::lock_guard<std::recursive_mutex> lg(Instance()->_deviceLock);
+            if (vkMapMemory(Instance()->_vDevice, vMemory, 0, size, 0, &memoryBlock._mapped) != VK_SUCCESS) {
+                Instance()->Logger().Error("failed to map memory!");
+                memoryBlock._mapped = nullptr;
+            }
+        }
 
-        auto localOffset = offset - it->_offset;
+        return blockIndex;
+    }
 
-        // adding offset block
-        if (localOffset > 0) {
-            auto newOffset = it->_offset;
-            auto newSize = localOffset;
-            memoryBlock._blocks.emplace(newOffset, newSize);
+    bool GpuAllocator::MemoryData::CreateMemoryBlock(VkDeviceSize minSize) {
+        if (_nextBlockSize == 0) {
+            _nextBlockSize = _config.minBlockSize;
+        }
 
-            _logicalBlocks.emplace(data.blockIndex, newOffset, newSize);
+        auto size = _nextBlockSize;
+        while (size < minSize) {
+            size *= 2;
         }
+        size = std::min(size, _config.maxBlockSize);
+
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.memoryTypeIndex = _memoryType;
 
-        // adding tail block
-        if (it->_size - localOffset > memRequirements.size) {
-            auto newOffset = it->_offset + localOffset + data.size;
-            auto newSize = it->_size - localOffset - data.size;
-            memoryBlock._blocks.emplace(newOffset, newSize);
+        // when the device is short on memory smaller blocks may still fit
+        VkDeviceMemory vMemory = VK_NULL_HANDLE;
+        for (; size >= minSize; size /= 2) {
+            allocInfo.allocationSize = size;
+            if (AllocateDeviceMemory(allocInfo, vMemory)) {
+                break;
+            }
+            vMemory = VK_NULL_HANDLE;
+        }
 
-            _logicalBlocks.emplace(data.blockIndex, newOffset, newSize);
+        if (vMemory == VK_NULL_HANDLE) {
+            Instance()->Logger().Error("failed to allocate buffer memory!");
+            return false;
         }
 
-        // deleting what we created
-        _logicalBlocks.erase(it);
+        _nextBlockSize = std::min(std::max(_nextBlockSize, size) * 2, _config.maxBlockSize);
+
+        auto blockIndex = EmplaceMemoryBlock(vMemory, size, false);
+        auto region = _tlsf.AddRegion(size);
+        if (region >= _blockByRegion.size()) {
+            _blockByRegion.resize(region + 1, NoBlock);
+            _emptySince.resize(region + 1, NotEmpty);
+        }
+        _blockByRegion[region] = blockIndex;
+        _emptySince[region] = NotEmpty;
 
         return true;
     }
 
-    decltype(std::multiset<GpuAllocator::MemoryData::LogicalBlock>{}.begin())
-        GpuAllocator::MemoryData::CreateMemoryBlock(uint32_t memoryType) {
+    void GpuAllocator::MemoryData::ReleaseMemoryBlock(uint32_t region) {
+        auto blockIndex = _blockByRegion[region];
+        _tlsf.RemoveRegion(region);
+        _blockByRegion[region] = NoBlock;
+
+        auto& memoryBlock = _memoryBlocks[blockIndex];
+        FreeDeviceMemory(memoryBlock._vMemory, memoryBlock._size, _memoryType);
+        memoryBlock._vMemory = VK_NULL_HANDLE;
+        memoryBlock._size = 0;
+        memoryBlock._mapped = nullptr;
+        _unusedBlocks.emplace_back(blockIndex);
+
+        for (uint32_t activeRegion = 0; activeRegion < _tlsf.regionCount(); ++activeRegion) {
+            if (_tlsf.regionActive(activeRegion)) {
+                return;
+            }
+        }
+        // the type went unused, growth starts over
+        _nextBlockSize = _config.minBlockSize;
+    }
 
-        uint32_t blockIndex = static_cast<uint32_t>(_memoryBlocks.size());
-        auto& memoryBlock = _memoryBlocks.emplace_back(RISE_GPU_ALLOCATOR_BLOCK_SIZE);
+    void GpuAllocator::MemoryData::ReleaseEmptyBlocks(uint64_t frame) {
+        for (uint32_t region = 0; region < _tlsf.regionCount(); ++region) {
+            // the drained block is released by the defragmenter
+            if (!_tlsf.regionActive(region) || _tlsf.regionLocked(region)) {
+                continue;
+            }
 
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memoryBlock._size;
-        allocInfo.memoryTypeIndex = memoryType;
+            if (_tlsf.regionUsed(region) != 0) {
+                _emptySince[region] = NotEmpty;
+                continue;
+            }
 
-        if (vkAllocateMemory(Instance()->_vDevice, &allocInfo, nullptr, &memoryBlock._vMemory) != VK_SUCCESS) {
-            Instance()->Logger().Error("failed to allocate buffer memory!");
+            if (_emptySince[region] == NotEmpty) {
+                _emptySince[region] = frame;
+            }
+            else if (frame - _emptySince[region] >= _config.emptyBlockFrames) {
+                ReleaseMemoryBlock(region);
+            }
         }
+    }
 
-        memoryBlock._blocks.emplace(0, memoryBlock._size);
-        return _logicalBlocks.emplace(blockIndex, 0, memoryBlock._size);
+    GpuStackAllocator::GpuStackAllocator(VkBufferUsageFlags usage, VkDeviceSize chunkSize)
+        : _usage(usage), _chunkSize(chunkSize) {}
+    GpuStackAllocator::~GpuStackAllocator() {
+        for (auto& chunk : _chunks) {
+            GpuAllocator::DestroyBuffer(chunk.buffer);
+        }
     }
 
-    // TODO change vulkan flags to "Gpu/Gpu-Cpu/Cpu" enum and support using more fast one, if requested is inaccessible
-    GpuStackAllocator::Buffer GpuStackAllocator::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkMemoryPropertyFlags ignoreProperties) {
-        VkBuffer buffer;
+    bool GpuStackAllocator::TryAllocate(Chunk& chunk, VkDeviceSize offset, VkDeviceSize size, VkDeviceSize alignment, Allocation& allocation) {
+        auto alignedOffset = (offset + alignment - 1) & ~(alignment - 1);
+        if (alignedOffset + size > chunk.size) {
+            return false;
+        }
 
-        VkBufferCreateInfo bufferInfo{};
-        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-        bufferInfo.size = size;
-        bufferInfo.usage = usage;
-        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        _offset = alignedOffset + size;
 
-        std::lock_guard<std::recursive_mutex> lg(Instance()->_deviceLock);
-        if (vkCreateBuffer(Instance()->_vDevice, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
-            Instance()->Logger().Error("failed to create buffer!");
+        allocation.vBuffer = chunk.buffer.vBuffer();
+        allocation.offset = alignedOffset;
+        allocation.size = size;
+        allocation.data = chunk.data + alignedOffset;
+        return true;
+    }
+
+    GpuStackAllocator::Allocation GpuStackAllocator::Allocate(VkDeviceSize size, VkDeviceSize alignment) {
+        Allocation allocation;
+        if (alignment == 0) {
+            alignment = 1;
         }
 
-        VkMemoryRequirements memRequirements;
-        vkGetBufferMemoryRequirements(Instance()->_vDevice, buffer, &memRequirements);
+        if (_chunkIndex < _chunks.size() && TryAllocate(_chunks[_chunkIndex], _offset, size, alignment, allocation)) {
+            return allocation;
+        }
 
-        VkDeviceMemory memory;
-        AllocationData allocationData;
-        Allocate(memRequirements, properties, ignoreProperties, memory, allocationData);
+        // chunks kept from previous cycles come first
+        for (++_chunkIndex; _chunkIndex < _chunks.size(); ++_chunkIndex) {
+            if (TryAllocate(_chunks[_chunkIndex], 0, size, alignment, allocation)) {
+                return allocation;
+            }
+        }
 
-        vkBindBufferMemory(Instance()->_vDevice, buffer, memory, allocationData.offset);
+        auto* chunk = CreateChunk(std::max(_chunkSize, size));
+        if (chunk == nullptr) {
+            return allocation;
+        }
+        _chunkIndex = _chunks.size() - 1;
 
-        return Buffer(buffer);
+        TryAllocate(*chunk, 0, size, alignment, allocation);
+        return allocation;
     }
 
-    bool GpuStackAllocator::Allocate(const VkMemoryRequirements& memRequirements, VkMemoryPropertyFlags properties, VkMemoryPropertyFlags ignoreProperties, VkDeviceMemory& memory, AllocationData& data) {
-        uint32_t memoryType = 0;
-        if (!GpuAllocator::FindMemoryType(memRequirements.memoryTypeBits, properties, ignoreProperties, memoryType)) {
-            Instance()->Logger().Error("failed to find suitable memory type!");
+    void GpuStackAllocator::Reset() {
+        _chunkIndex = 0;
+        _offset = 0;
+    }
+
+    GpuStackAllocator::Chunk* GpuStackAllocator::CreateChunk(VkDeviceSize size) {
+        auto buffer = GpuAllocator::CreateBuffer(size, _usage, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        if (buffer.vBuffer() == VK_NULL_HANDLE) {
+            return nullptr;
         }
 
-        auto& memoryData = _memoryByType.try_emplace(memoryType).first->second;
-        auto result = memoryData.Allocate(memoryType, memRequirements, data);
+        auto& chunk = _chunks.emplace_back();
+        chunk.buffer = buffer;
+        chunk.size = size;
+        chunk.data = reinterpret_cast<uint8_t*>(buffer.MapMemory().ptr());
+        return &chunk;
+    }
 
-        return result;
+    GpuAliasAllocator::~GpuAliasAllocator() {
+        Release();
     }
 
-    bool GpuStackAllocator::MemoryData::Allocate(uint32_t memoryType, const VkMemoryRequirements& memRequirements, AllocationData& data) {
-        // TODO take into account alignment
-        if (memRequirements.size > RISE_GPU_ALLOCATOR_BLOCK_SIZE) {
-            Instance()->Logger().Error("block size less then requested memory size!");
+    bool GpuAliasAllocator::Declaration::operator==(const Declaration& other) const {
+        return extent.width == other.extent.width && extent.height == other.extent.height && extent.depth == other.extent.depth
+            && format == other.format && usage == other.usage
+            && firstPass == other.firstPass && lastPass == other.lastPass;
+    }
+
+    GpuAliasAllocator::Id GpuAliasAllocator::Declare(const VkExtent3D& extent, VkFormat format, VkImageUsageFlags usage, uint32_t firstPass, uint32_t lastPass) {
+        auto& declaration = _declarations.emplace_back();
+        declaration.extent = extent;
+        declaration.format = format;
+        declaration.usage = usage;
+        declaration.firstPass = firstPass;
+        declaration.lastPass = std::max(firstPass, lastPass);
+        return static_cast<Id>(_declarations.size() - 1);
+    }
+
+    bool GpuAliasAllocator::Build() {
+        if (_declarations == _builtDeclarations) {
+            return false;
         }
 
-        if (_memoryBlocks.empty() || _memoryBlocks.back().freeSpace() < memRequirements.size) {
-            CreateMemoryBlock(memoryType);
+        Release();
+        _builtDeclarations = _declarations;
+        _images.resize(_declarations.size());
+
+        for (size_t i = 0; i < _declarations.size(); ++i) {
+            if (!CreateImage(_declarations[i], _images[i])) {
+                Release();
+                return true;
+            }
         }
 
-        auto& memoryBlock = _memoryBlocks.back();
+        std::vector<uint32_t> memoryTypes;
+        for (const auto& image : _images) {
+            if (std::find(memoryTypes.begin(), memoryTypes.end(), image.memoryType) == memoryTypes.end()) {
+                memoryTypes.emplace_back(image.memoryType);
+            }
+        }
 
-        data.offset = memoryBlock._usedSize;
+        for (auto memoryType : memoryTypes) {
+            auto& memory = _memories.emplace_back();
+            memory.memoryType = memoryType;
+            memory.size = Place(memoryType);
 
-        memoryBlock._usedSize += memRequirements.size;
+            VkMemoryAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+            allocInfo.allocationSize = memory.size;
+            allocInfo.memoryTypeIndex = memoryType;
+
+            bool allocated;
+            {
+                std::unique_lock ul(GpuAllocator::_allocationLock);
+                allocated = GpuAllocator::AllocateDeviceMemory(allocInfo, memory.vMemory);
+            }
+            if (!allocated) {
+                Instance()->Logger().Error("failed to allocate aliased image memory!");
+                _memories.pop_back();
+                Release();
+                return true;
+            }
+
+            std::lock_guard<std::recursive_mutex> lg(Instance()->_deviceLock);
+            for (const auto& image : _images) {
+                if (image.memoryType == memoryType) {
+                    vkBindImageMemory(Instance()->_vDevice, image.vImage, memory.vMemory, image.offset);
+                }
+            }
+        }
 
         return true;
     }
-    
-    void GpuStackAllocator::MemoryData::CreateMemoryBlock(uint32_t memoryType) {
 
-        uint32_t blockIndex = static_cast<uint32_t>(_memoryBlocks.size());
-        auto& memoryBlock = _memoryBlocks.emplace_back(RISE_GPU_ALLOCATOR_BLOCK_SIZE);
+    bool GpuAliasAllocator::CreateImage(const Declaration& declaration, AliasedImage& image) {
+        constexpr VkImageUsageFlags attachmentUsages = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT
+            | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+        auto transient = (declaration.usage & ~attachmentUsages) == 0;
 
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memoryBlock._size;
-        allocInfo.memoryTypeIndex = memoryType;
+        auto usage = declaration.usage;
+        if (transient) {
+            usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+        }
+        auto imageInfo = ImageCreateInfo(declaration.extent, declaration.format, usage);
 
-        if (vkAllocateMemory(Instance()->_vDevice, &allocInfo, nullptr, &memoryBlock._vMemory) != VK_SUCCESS) {
-            Instance()->Logger().Error("failed to allocate buffer memory!");
+        std::lock_guard<std::recursive_mutex> lg(Instance()->_deviceLock);
+        if (vkCreateImage(Instance()->_vDevice, &imageInfo, nullptr, &image.vImage) != VK_SUCCESS) {
+            Instance()->Logger().Error("failed to create aliased image!");
+            image.vImage = VK_NULL_HANDLE;
+            return false;
+        }
+
+        vkGetImageMemoryRequirements(Instance()->_vDevice, image.vImage, &image.requirements);
+
+        auto typeBits = image.requirements.memoryTypeBits;
+        if (!(transient && GpuAllocator::FindMemoryType(typeBits, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, 0, image.memoryType))
+            && !GpuAllocator::FindMemoryType(typeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, image.memoryType)
+            && !GpuAllocator::FindMemoryType(typeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, image.memoryType)) {
+            Instance()->Logger().Error("failed to find suitable memory type!");
+            return false;
+        }
+
+        return true;
+    }
+
+    VkDeviceSize GpuAliasAllocator::Place(uint32_t memoryType) {
+        std::vector<size_t> order;
+        for (size_t i = 0; i < _images.size(); ++i) {
+            if (_images[i].memoryType == memoryType) {
+                order.emplace_back(i);
+            }
+        }
+
+        // the biggest first, the smaller ones then fill the gaps around them
+        std::sort(order.begin(), order.end(), [this](size_t lhs, size_t rhs) {
+            return _images[lhs].requirements.size > _images[rhs].requirements.size;
+        });
+
+        VkDeviceSize memorySize = 0;
+        std::vector<std::pair<VkDeviceSize, VkDeviceSize>> taken;
+        for (size_t placed = 0; placed < order.size(); ++placed) {
+            auto& image = _images[order[placed]];
+            const auto& declaration = _declarations[order[placed]];
+
+            // ranges of the images alive at the same time
+            taken.clear();
+            for (size_t other = 0; other < placed; ++other) {
+                if (_declarations[order[other]].Overlaps(declaration)) {
+                    const auto& otherImage = _images[order[other]];
+                    taken.emplace_back(otherImage.offset, otherImage.offset + otherImage.requirements.size);
+                }
+            }
+            std::sort(taken.begin(), taken.end());
+
+            auto alignment = image.requirements.alignment;
+            VkDeviceSize offset = 0;
+            for (const auto& [begin, end] : taken) {
+                if (offset + image.requirements.size <= begin) {
+                    break;
+                }
+                offset = std::max(offset, (end + alignment - 1) / alignment * alignment);
+            }
+
+            image.offset = offset;
+            memorySize = std::max(memorySize, offset + image.requirements.size);
+        }
+
+        return memorySize;
+    }
+
+    void GpuAliasAllocator::Release() {
+        if (_images.empty() && _memories.empty()) {
+            _builtDeclarations.clear();
+            return;
+        }
+
+        GpuAllocator::Retire([images = std::move(_images), memories = std::move(_memories)]() {
+            {
+                std::lock_guard<std::recursive_mutex> lg(Instance()->_deviceLock);
+                for (const auto& image : images) {
+                    if (image.vImage != VK_NULL_HANDLE) {
+                        vkDestroyImage(Instance()->_vDevice, image.vImage, nullptr);
+                    }
+                }
+            }
+
+            std::unique_lock ul(GpuAllocator::_allocationLock);
+            for (const auto& memory : memories) {
+                GpuAllocator::FreeDeviceMemory(memory.vMemory, memory.size, memory.memoryType);
+            }
+        });
+
+        _images.clear();
+        _memories.clear();
+        _builtDeclarations.clear();
+    }
+
+    VkDeviceSize GpuAliasAllocator::memorySize() const {
+        VkDeviceSize size = 0;
+        for (const auto& memory : _memories) {
+            size += memory.size;
+        }
+        return size;
+    }
+
+    VkDeviceSize GpuAliasAllocator::unaliasedSize() const {
+        VkDeviceSize size = 0;
+        for (const auto& image : _images) {
+            size += image.requirements.size;
         }
+        return size;
     }
 
 }
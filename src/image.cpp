@@ -2,6 +2,7 @@
 #include "Rise/image.h"
 
 #include "Rise/gpu_allocator.h"
+#include "Rise/upload_queue.h"
 
 #include "stb_image.h"
 
@@ -55,7 +56,27 @@ namespace Rise {
 
 	void IImage::Load(VkImage vImage, VkImageAspectFlags aspectFlags, bool singleByte /*= false*/) {
 		_vImage = vImage;
+		_aspectFlags = aspectFlags;
+		_singleByte = singleByte;
 
+		_vImageView = CreateImageView();
+
+		MarkLoaded();
+	}
+
+	void IImage::Relocate(VkImage vImage) {
+		_vImage = vImage;
+
+		// frames in flight may still sample through the old view
+		GpuAllocator::Retire([vImageView = _vImageView]() {
+			std::lock_guard<std::recursive_mutex> lg(Instance()->_deviceLock);
+			vkDestroyImageView(Instance()->_vDevice, vImageView, nullptr);
+		});
+
+		_vImageView = CreateImageView();
+	}
+
+	VkImageView IImage::CreateImageView() {
 		VkImageViewCreateInfo createInfo{};
 		createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
 		createInfo.image = _vImage;
@@ -63,7 +84,7 @@ namespace Rise {
 		createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
 		createInfo.format = GetMeta()->vFormat;
 
-		if (!singleByte) {
+		if (!_singleByte) {
 			createInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
 			createInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
 			createInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
@@ -76,18 +97,20 @@ namespace Rise {
 			createInfo.components.a = VK_COMPONENT_SWIZZLE_R;
 		}
 
-		createInfo.subresourceRange.aspectMask = aspectFlags;
+		createInfo.subresourceRange.aspectMask = _aspectFlags;
 		createInfo.subresourceRange.baseMipLevel = 0;
 		createInfo.subresourceRange.levelCount = 1;
 		createInfo.subresourceRange.baseArrayLayer = 0;
 		createInfo.subresourceRange.layerCount = 1;
 
+		VkImageView vImageView = nullptr;
+
 		std::lock_guard<std::recursive_mutex> lg(Instance()->_deviceLock);
-		if (vkCreateImageView(Instance()->_vDevice, &createInfo, nullptr, &_vImageView) != VK_SUCCESS) {
+		if (vkCreateImageView(Instance()->_vDevice, &createInfo, nullptr, &vImageView) != VK_SUCCESS) {
 			Error("failed to create image views!");
 		}
 
-		MarkLoaded();
+		return vImageView;
 	}
 
 	void IImage::Unload() {
@@ -99,19 +122,33 @@ namespace Rise {
 		return _framebuffers.try_emplace(&renderPass, Instance(), renderPass, *this).first->second;
 	}
 
-	void Image::LoadFromFile(const std::string& filename) {
+	void Image::LoadFromFile(const std::string& filename, const CancellationToken& token) {
+		if (token.IsCancelled()) {
+			MarkCancelled();
+			return;
+		}
+
 		int texWidth, texHeight, texChannels;
 
 		stbi_uc* pixels = stbi_load(filename.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
 
 		if (!pixels) {
 			Error("Failed to load texture file " + filename);
+			MarkFailed();
 			return;
 		}
 
 		if (texWidth != GetMeta()->size.width ||
 			texHeight != GetMeta()->size.height) {
 			Error("Meta size doesn't equal actual texture size" + filename);
+			stbi_image_free(pixels);
+			MarkFailed();
+			return;
+		}
+
+		if (token.IsCancelled()) {
+			stbi_image_free(pixels);
+			MarkCancelled();
 			return;
 		}
 
@@ -119,7 +156,13 @@ namespace Rise {
 		VkDeviceSize imageSize = GetMeta()->size.width * GetMeta()->size.height * 4;
 
 		//allocate temporary buffer for holding texture data to upload
-		auto stagingBuffer = GpuAllocator::CreateBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		auto stagingBuffer = Instance()->Uploads().Staging().Acquire(imageSize);
+		if (stagingBuffer.vBuffer() == VK_NULL_HANDLE) {
+			Error("Failed to get a staging buffer for " + filename);
+			stbi_image_free(pixels);
+			MarkFailed();
+			return;
+		}
 
 		{
 			//copy data to buffer
@@ -137,15 +180,31 @@ namespace Rise {
 		imageExtent.height = static_cast<uint32_t>(texHeight);
 		imageExtent.depth = 1;
 		
-		_image = GpuAllocator::CreateImage(imageExtent, GetMeta()->vFormat, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+		_image = GpuAllocator::CreateImage(imageExtent, GetMeta()->vFormat, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+		if (_image.vImage() == VK_NULL_HANDLE) {
+			Error("Failed to create texture image " + filename);
+			Instance()->Uploads().Staging().Release(stagingBuffer);
+			MarkFailed();
+			return;
+		}
+		GpuAllocator::SetOwner(_image, filename);
 
-		GpuAllocator::CopyBufferToImage(stagingBuffer, imageSize, _image, imageExtent);
-		GpuAllocator::DestroyBuffer(stagingBuffer);
+		_upload = Instance()->Uploads().CopyBufferToImage(stagingBuffer, _image, imageExtent, [this, stagingBuffer]() {
+			Instance()->Uploads().Staging().Release(stagingBuffer);
+			Load(_image.vImage(), VK_IMAGE_ASPECT_COLOR_BIT);
 
-		Load(_image.vImage(), VK_IMAGE_ASPECT_COLOR_BIT);
+			_relocation = GpuAllocator::SetRelocatable(_image, [this](GpuAllocator::Image image) {
+				_image = image;
+				Relocate(image.vImage());
+			});
+		});
 	}
 
 	void Image::Unload() {
+		// a relocation callback mustn't swap the image while it's torn down
+		if (_relocation) {
+			_relocation->Revoke();
+		}
 		IImage::Unload();
 		GpuAllocator::DestroyImage(_image);
 	}
@@ -162,45 +221,122 @@ namespace Rise {
 		imageExtent.depth = 1;
 
 		_image = GpuAllocator::CreateImage(imageExtent, GetMeta()->vFormat, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+		if (_image.vImage() == VK_NULL_HANDLE) {
+			Error("failed to create target image!");
+			MarkFailed();
+			return;
+		}
+
+		IImage::Load(_image.vImage(), VK_IMAGE_ASPECT_COLOR_BIT);
+	}
+	void TargetImage::Load(const GpuAliasAllocator& aliases, GpuAliasAllocator::Id id) {
+		if (aliases.image(id).vImage() == VK_NULL_HANDLE) {
+			// the last Build() failed, a view of the previous image would outlive it
+			Error("aliased target image isn't built!");
+			if (IsLoaded()) {
+				Unload();
+			}
+			MarkFailed();
+			return;
+		}
+
+		if (IsLoaded() && _aliased) {
+			// the replaced image is retired, frames in flight may still use its view
+			_image = aliases.image(id);
+			Relocate(_image.vImage());
+			return;
+		}
+
+		if (IsLoaded()) {
+			Unload();
+		}
+
+		_image = aliases.image(id);
+		_aliased = true;
 
 		IImage::Load(_image.vImage(), VK_IMAGE_ASPECT_COLOR_BIT);
 	}
 	void TargetImage::Unload() {
 		IImage::Unload();
-		GpuAllocator::DestroyImage(_image);
+		if (!_aliased) {
+			GpuAllocator::DestroyImage(_image);
+		}
+		_image = {};
+		_aliased = false;
 	}
 
 	GpuAllocator::Buffer::MapPtr CustomImage::LoadPrepare(uint32_t pixelSize) {
 		VkDeviceSize imageSize = GetMeta()->size.width * GetMeta()->size.height * pixelSize;
 
 		//allocate temporary buffer for holding texture data to upload
-		_stagingBuffer = GpuAllocator::CreateBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		_stagingBuffer = Instance()->Uploads().Staging().Acquire(imageSize);
+		if (_stagingBuffer.vBuffer() == VK_NULL_HANDLE) {
+			Error("failed to get a staging buffer for the image!");
+			MarkFailed();
+		}
 
 		return _stagingBuffer.MapMemory();
 
 	}
-	void CustomImage::LoadCommit(uint32_t pixelSize) {
-		VkDeviceSize imageSize = GetMeta()->size.width * GetMeta()->size.height * pixelSize;
+	bool CustomImage::LoadCommit(uint32_t pixelSize) {
+		if (_stagingBuffer.vBuffer() == VK_NULL_HANDLE) {
+			return false;
+		}
+
 
 		VkExtent3D imageExtent;
 		imageExtent.width = static_cast<uint32_t>(GetMeta()->size.width);
 		imageExtent.height = static_cast<uint32_t>(GetMeta()->size.height);
 		imageExtent.depth = 1;
 
-		_image = GpuAllocator::CreateImage(imageExtent, GetMeta()->vFormat, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
-
-		GpuAllocator::CopyBufferToImage(_stagingBuffer, imageSize, _image, imageExtent);
-		GpuAllocator::DestroyBuffer(_stagingBuffer);
+		_image = GpuAllocator::CreateImage(imageExtent, GetMeta()->vFormat, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+		if (_image.vImage() == VK_NULL_HANDLE) {
+			Error("failed to create image!");
+			Instance()->Uploads().Staging().Release(_stagingBuffer);
+			_stagingBuffer = {};
+			MarkFailed();
+			return false;
+		}
 
-		IImage::Load(_image.vImage(), VK_IMAGE_ASPECT_COLOR_BIT, true);
+		_upload = Instance()->Uploads().CopyBufferToImage(_stagingBuffer, _image, imageExtent, [this, stagingBuffer = _stagingBuffer]() {
+			Instance()->Uploads().Staging().Release(stagingBuffer);
+			IImage::Load(_image.vImage(), VK_IMAGE_ASPECT_COLOR_BIT, true);
+
+			_relocation = GpuAllocator::SetRelocatable(_image, [this](GpuAllocator::Image image) {
+				_image = image;
+				Relocate(image.vImage());
+			});
+		});
+		_stagingBuffer = {};
+		return true;
 	}
 
 	void CustomImage::Unload() {
+		// a relocation callback mustn't swap the image while it's torn down
+		if (_relocation) {
+			_relocation->Revoke();
+		}
 		IImage::Unload();
 		GpuAllocator::DestroyImage(_image);
 	}
 
+	// the generator isn't thread safe, so the texture is requested here rather than in the load job
+	N9Slice::N9Slice(Core* core, const Meta* meta)
+		: RiseObject(core) {
+		SetupMeta(*meta);
+		_image = Instance()->ResourceGenerator().Get<Image>(meta->textureId);
+	}
+
+	std::vector<JobHandle> N9Slice::Dependencies() {
+		return { _image->LoadedHandle() };
+	}
+
 	void N9Slice::Load() {
-		_image = Instance()->ResourceGenerator().Get<Image>(meta()->textureId);
+		if (!_image->IsLoaded()) {
+			Error("9 slice texture failed to load!");
+			MarkFailed();
+			return;
+		}
+		MarkLoaded();
 	}
 }
@@ -1,37 +1,325 @@
 //☀Rise☀
 #include "Rise/loader.h"
 
+#include <algorithm>
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 namespace Rise {
 
-	Loader::Loader(uint32_t threadCount) {
+	namespace {
+
+		// set on the workers' own threads
+		thread_local const Loader* tLoader = nullptr;
+		thread_local uint32_t tWorkerIndex = 0;
+
+	}
+
+	JobHandle JobHandle::Pending() {
+		JobHandle handle;
+		handle._state = std::make_shared<State>();
+		return handle;
+	}
+
+	void JobHandle::Complete() const {
+		if (!_state) {
+			return;
+		}
+
+		std::vector<std::function<void()>> continuations;
+		{
+			std::lock_guard<std::mutex> lg(_state->lock);
+			if (_state->complete) {
+				return;
+			}
+			_state->complete = true;
+			continuations.swap(_state->continuations);
+		}
+
+		for (auto& continuation : continuations) {
+			continuation();
+		}
+	}
+
+	bool JobHandle::IsComplete() const {
+		if (!_state) {
+			return true;
+		}
+
+		std::lock_guard<std::mutex> lg(_state->lock);
+		return _state->complete;
+	}
+
+	void JobHandle::Then(std::function<void()> continuation) const {
+		if (_state) {
+			std::lock_guard<std::mutex> lg(_state->lock);
+			if (!_state->complete) {
+				_state->continuations.emplace_back(std::move(continuation));
+				return;
+			}
+		}
+
+		continuation();
+	}
+
+	std::mutex Loader::_configLock;
+	Loader::Config Loader::_config;
+
+	void Loader::SetConfig(const Config& config) {
+		std::lock_guard<std::mutex> lg(_configLock);
+		_config = config;
+	}
+
+	Loader::Config Loader::config() {
+		std::lock_guard<std::mutex> lg(_configLock);
+		return _config;
+	}
+
+	uint32_t Loader::AutoThreadCount(uint32_t reservedThreads) {
+		// may be 0 when it can't be told
+		auto hardwareThreads = std::thread::hardware_concurrency();
+		if (hardwareThreads <= reservedThreads) {
+			return 1;
+		}
+		return hardwareThreads - reservedThreads;
+	}
+
+	Loader::Loader(uint32_t threadCount)
+		: Loader([threadCount]() {
+			auto config = Loader::config();
+			config.threadCount = threadCount;
+			return config;
+		}()) {}
+
+	Loader::Loader(const Config& config)
+		: _instanceConfig(config), _jobPool(sizeof(Job)) {
+		_blocked->loader = this;
+
+		auto threadCount = config.threadCount;
+		if (threadCount == 0) {
+			threadCount = AutoThreadCount(config.reservedThreads);
+		}
+
+		// every deque exists before any thread may try to steal from it
+		for (uint32_t i = 0; i < threadCount; ++i) {
+			auto& worker = _workers.emplace_back(std::make_unique<Worker>());
+			worker->random = i * 2654435761u + 1;
+		}
 		for (uint32_t i = 0; i < threadCount; ++i) {
-			_jobThreads.emplace_back(std::bind(&Loader::ThreadLoop, this));
+			_workers[i]->thread = std::thread(&Loader::ThreadLoop, this, i);
 		}
 	}
 	Loader::~Loader() {
 		{
-			std::unique_lock<std::mutex> ul(_queueLock);
+			std::unique_lock<std::mutex> ul(_sleepLock);
 			_destroying = true;
-			_queueCond.notify_all();
+			_wakeCond.notify_all();
+		}
+		for (auto& worker : _workers) {
+			worker->thread.join();
+		}
+
+		// dependencies may still complete later, their continuations find no loader
+		std::unordered_set<Job*> blocked;
+		{
+			std::lock_guard<std::mutex> lg(_blocked->lock);
+			_blocked->loader = nullptr;
+			blocked.swap(_blocked->jobs);
+		}
+		for (auto* job : blocked) {
+			_jobPool.destroy(job);
+		}
+
+		// unblocked by other threads while the workers were exiting
+		for (auto& injected : _injected) {
+			for (auto* job : injected) {
+				_jobPool.destroy(job);
+			}
+		}
+	}
+
+	bool Loader::IsWorkerThread() const {
+		return tLoader == this;
+	}
+
+	void Loader::AddDependencies(Job* job, const std::vector<JobHandle>& dependencies) {
+		{
+			std::lock_guard<std::mutex> lg(_blocked->lock);
+			_blocked->jobs.emplace(job);
+		}
+
+		for (const auto& dependency : dependencies) {
+			job->_blockers.fetch_add(1);
+			dependency.Then([blocked = _blocked, job]() {
+				std::lock_guard<std::mutex> lg(blocked->lock);
+				if (blocked->loader != nullptr) {
+					blocked->loader->Unblock(job);
+				}
+			});
+		}
+
+		std::lock_guard<std::mutex> lg(_blocked->lock);
+		Unblock(job);
+	}
+
+	void Loader::Unblock(Job* job) {
+		if (job->_blockers.fetch_sub(1) == 1) {
+			_blocked->jobs.erase(job);
+			Push(job);
+		}
+	}
+
+	void Loader::Push(Job* job) {
+		auto priority = static_cast<uint32_t>(job->_priority);
+		if (IsWorkerThread()) {
+			_workers[tWorkerIndex]->deques[priority].Push(job);
+		}
+		else {
+			std::lock_guard<std::mutex> lg(_injectedLock);
+			_injected[priority].emplace_back(job);
+			_injectedCount[priority].fetch_add(1);
 		}
-		for (auto& thread : _jobThreads) {
-			thread.join();
+
+		// pairs with the sleeping count being raised before the pending one is checked
+		_pending.fetch_add(1);
+		if (_sleeping.load() != 0) {
+			std::lock_guard<std::mutex> lg(_sleepLock);
+			_wakeCond.notify_one();
 		}
 	}
 
-	void Loader::ThreadLoop() {
+	Loader::Job* Loader::Find(uint32_t workerIndex) {
+		for (uint32_t priority = 0; priority < JobPriorityCount; ++priority) {
+			Job* job = nullptr;
+			if (_workers[workerIndex]->deques[priority].Pop(job)) {
+				return job;
+			}
+			if (job = TakeInjected(workerIndex, priority); job != nullptr) {
+				return job;
+			}
+			if (job = Steal(workerIndex, priority); job != nullptr) {
+				return job;
+			}
+		}
+		return nullptr;
+	}
+
+	Loader::Job* Loader::TakeInjected(uint32_t workerIndex, uint32_t priority) {
+		if (_injectedCount[priority].load(std::memory_order_relaxed) == 0) {
+			return nullptr;
+		}
+
+		std::lock_guard<std::mutex> lg(_injectedLock);
+		auto& injected = _injected[priority];
+		if (injected.empty()) {
+			return nullptr;
+		}
+
+		// takes a batch, so that the others steal the rest from the deque instead of queuing on the lock
+		auto count = std::min<size_t>({ injected.size() / _workers.size() + 1, injected.size(), RISE_LOADER_INJECTED_BATCH });
+		auto* job = injected.front();
+		for (size_t i = 1; i < count; ++i) {
+			_workers[workerIndex]->deques[priority].Push(injected[i]);
+		}
+		injected.erase(injected.begin(), injected.begin() + count);
+		_injectedCount[priority].fetch_sub(static_cast<uint32_t>(count));
+		return job;
+	}
+
+	Loader::Job* Loader::Steal(uint32_t workerIndex, uint32_t priority) {
+		auto count = static_cast<uint32_t>(_workers.size());
+		if (count == 1) {
+			return nullptr;
+		}
+
+		auto& random = _workers[workerIndex]->random;
+		random ^= random << 13;
+		random ^= random >> 17;
+		random ^= random << 5;
+
+		Job* job = nullptr;
+		for (uint32_t i = 0, first = random % count; i < count; ++i) {
+			auto victim = (first + i) % count;
+			if (victim != workerIndex && _workers[victim]->deques[priority].Steal(job)) {
+				return job;
+			}
+		}
+		return nullptr;
+	}
+
+	void Loader::Run(Job* job) {
+		_pending.fetch_sub(1);
+		(*job)();
+
+		auto handle = std::move(job->_handle);
+		_jobPool.destroy(job);
+		handle.Complete();
+	}
+
+	void Loader::SetupThread(uint32_t workerIndex) {
+		if (!_instanceConfig.threadName.empty()) {
+			auto name = _instanceConfig.threadName + " " + std::to_string(workerIndex);
+#if defined(_WIN32)
+			SetThreadDescription(GetCurrentThread(), std::wstring(name.begin(), name.end()).c_str());
+#elif defined(__linux__)
+			// longer names are refused
+			name.resize(std::min<size_t>(name.size(), 15));
+			pthread_setname_np(pthread_self(), name.c_str());
+#endif
+		}
+
+		if (_instanceConfig.pinThreads) {
+			auto hardwareThreads = std::max<uint32_t>(std::thread::hardware_concurrency(), 1);
+			auto core = (_instanceConfig.reservedThreads + workerIndex) % hardwareThreads;
+#if defined(_WIN32)
+			if (core < sizeof(DWORD_PTR) * 8) {
+				SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << core);
+			}
+#elif defined(__linux__)
+			cpu_set_t cpuSet;
+			CPU_ZERO(&cpuSet);
+			CPU_SET(core, &cpuSet);
+			pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+#endif
+		}
+	}
+
+	void Loader::ThreadLoop(uint32_t workerIndex) {
+		tLoader = this;
+		tWorkerIndex = workerIndex;
+		SetupThread(workerIndex);
+
 		while (true) {
-			std::unique_lock<std::mutex> ul(_queueLock);
-			_queueCond.wait(ul, [=]() { return !_workQueue.empty() || _destroying; });
-			if (_workQueue.empty()) {
-				return;
+			Job* job = nullptr;
+			for (uint32_t spin = 0; spin < RISE_LOADER_SPIN_COUNT && job == nullptr; ++spin) {
+				job = Find(workerIndex);
+				if (job == nullptr) {
+					if (_pending.load() == 0) {
+						break;
+					}
+					// the job is being taken by someone else, or its owner needs the core
+					std::this_thread::yield();
+				}
+			}
+
+			if (job != nullptr) {
+				Run(job);
+				continue;
 			}
 
-			auto job = std::move(_workQueue.front());
-			_workQueue.pop();
-			ul.unlock();
+			std::unique_lock<std::mutex> ul(_sleepLock);
+			_sleeping.fetch_add(1);
+			_wakeCond.wait(ul, [this]() { return _pending.load() != 0 || _destroying; });
+			_sleeping.fetch_sub(1);
 
-			job();
+			if (_destroying && _pending.load() == 0) {
+				return;
+			}
 		}
 	}
 
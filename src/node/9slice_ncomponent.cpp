@@ -11,10 +11,14 @@ namespace Rise {
         : NComponent(core) {}
     N9SliceNComponent::N9SliceNComponent(Core* core, const Data& config)
         : NComponent(core) {
-        _texture = Rise::Instance()->ResourceGenerator().Get<N9Slice>(config["texture"]);
+        _textureLoad = LoadTexture(config["texture"]);
     }
     N9SliceNComponent::~N9SliceNComponent() {}
 
+    Task N9SliceNComponent::LoadTexture(std::string id) {
+        _texture = co_await Rise::Instance()->ResourceGenerator().GetAsync<N9Slice>(id);
+    }
+
     void N9SliceNComponent::draw(Draw::Context context) {
         if (!_texture) {
             return;
@@ -11,12 +11,20 @@ namespace Rise {
         : NComponent(core) {}
     LabelNComponent::LabelNComponent(Core* core, const Data& config)
         : NComponent(core) {
-        _font = Rise::Instance()->ResourceGenerator().Get<Font>(config["font"]);
         _size = config["size"].as(_size);
+        _fontLoad = LoadFont(config["font"]);
     }
     LabelNComponent::~LabelNComponent() {}
 
+    Task LabelNComponent::LoadFont(std::string id) {
+        _font = co_await Rise::Instance()->ResourceGenerator().GetAsync<Font>(id);
+    }
+
     void LabelNComponent::draw(Draw::Context context) {
+        if (!_font) {
+            return;
+        }
+
         auto point = GetPos();
         point.y += GetSize().height;
         Draw::drawText(context, _text, point, _font, _size);
@@ -75,13 +75,20 @@ namespace Rise {
         }
     }
 
+    std::vector<JobHandle> Renderer::Dependencies() {
+        return { _renderPass->LoadedHandle(), meta()->_vertShader->LoadedHandle(), meta()->_fragShader->LoadedHandle() };
+    }
+
     void Renderer::Load() {
-        while (!_renderPass->IsLoaded()) {}
+        if (!_renderPass->IsLoaded() || !meta()->_vertShader->IsLoaded() || !meta()->_fragShader->IsLoaded()) {
+            Error("renderer's render pass or shaders failed to load!");
+            MarkFailed();
+            return;
+        }
+
         CreatePipelineLayout(_vPipelineLayout);
 
-        while (!meta()->_vertShader->IsLoaded()) {}
         auto vertModule = meta()->_vertShader->createModule();
-        while (!meta()->_fragShader->IsLoaded()) {}
         auto fragModule = meta()->_fragShader->createModule();
 
         VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
@@ -335,8 +342,11 @@ namespace Rise {
         }
     }
 
-    void Renderer::BindDescriptorSet(VkCommandBuffer commandBuffer, Uniform& uniform) {
-        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _vPipelineLayout, 0, 1, &uniform.vDescriptorSet, 0, nullptr);
+    void Renderer::BindDescriptorSet(VkCommandBuffer commandBuffer, uint32_t set, const Uniform& uniform) {
+        // every implementation supports at least 8 dynamic uniform buffers per layout
+        uint32_t dynamicOffsets[16];
+        auto dynamicOffsetCount = uniform.DynamicOffsets(dynamicOffsets, 16);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _vPipelineLayout, set, 1, &uniform.vDescriptorSet, dynamicOffsetCount, dynamicOffsets);
     }
 
     void Renderer::PushConstant(VkCommandBuffer commandBuffer, VkShaderStageFlags stageFlags, uint32_t offset, const std::vector<uint8_t>& data) {
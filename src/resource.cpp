@@ -6,7 +6,151 @@
 #include "Rise/loader.h"
 #include "Rise/rise.h"
 
+#include <array>
+#include <condition_variable>
+
 namespace Rise {
 
+    namespace {
+
+        // std::atomic::wait can't time out, timed waiters sleep on one of these instead
+        struct WaitSlot {
+            std::mutex lock;
+            std::condition_variable cond;
+        };
+
+        WaitSlot& WaitSlotOf(const void* resource) {
+            static std::array<WaitSlot, 32> slots;
+            auto hash = reinterpret_cast<uintptr_t>(resource) >> 6;
+            return slots[hash % slots.size()];
+        }
+
+        bool IsFinished(ResourceBase::LoadState state) {
+            return state != ResourceBase::LoadState::Loading;
+        }
+
+    }
+
+    bool CancellationToken::IsCancelled() const {
+        if (!_bound) {
+            return false;
+        }
+
+        auto resource = _resource.lock();
+        if (!resource) {
+            return true;
+        }
+
+        // neither this reference, nor the one of the running load, nor the cache's are users
+        auto users = resource.use_count() - 2;
+        if (resource->_cached.load()) {
+            --users;
+        }
+        return users <= 0;
+    }
+
+    bool ResourceBase::WaitLoaded(std::chrono::milliseconds timeout) {
+        auto state = _state.load(std::memory_order_acquire);
+        if (IsFinished(state)) {
+            return state == LoadState::Loaded;
+        }
+
+        if (timeout == std::chrono::milliseconds::max()) {
+            while (!IsFinished(state)) {
+                _state.wait(state, std::memory_order_acquire);
+                state = _state.load(std::memory_order_acquire);
+            }
+            return state == LoadState::Loaded;
+        }
+
+        auto& slot = WaitSlotOf(this);
+        std::unique_lock<std::mutex> ul(slot.lock);
+        // pairs with the load of the waiters after a state change in Finish()
+        _timedWaiters.fetch_add(1);
+        slot.cond.wait_for(ul, timeout, [this, &state]() {
+            state = _state.load();
+            return IsFinished(state);
+        });
+        _timedWaiters.fetch_sub(1);
+
+        return state == LoadState::Loaded;
+    }
+
+    void ResourceBase::OnLoaded(std::function<void(bool loaded)> callback) {
+        LoadState state;
+        {
+            std::lock_guard<std::mutex> lg(_lock);
+            state = _state.load(std::memory_order_relaxed);
+            if (!IsFinished(state)) {
+                _callbacks.emplace_back(std::move(callback));
+                return;
+            }
+        }
+        callback(state == LoadState::Loaded);
+    }
+
+    JobHandle ResourceBase::LoadedHandle() {
+        std::lock_guard<std::mutex> lg(_lock);
+        return _loadedHandle;
+    }
+
+    void ResourceBase::MarkLoaded() {
+        Finish(LoadState::Loaded);
+    }
+
+    void ResourceBase::MarkFailed() {
+        Finish(LoadState::Failed);
+    }
+
+    void ResourceBase::MarkCancelled() {
+        Finish(LoadState::Unloaded);
+    }
+
+    void ResourceBase::MarkUnloaded() {
+        std::lock_guard<std::mutex> lg(_lock);
+        _state.store(LoadState::Unloaded, std::memory_order_release);
+        _boost = nullptr;
+        if (_loadedHandle.IsComplete()) {
+            _loadedHandle = JobHandle::Pending();
+        }
+    }
+
+    void ResourceBase::Boost() {
+        std::function<void()> boost;
+        {
+            std::lock_guard<std::mutex> lg(_lock);
+            boost.swap(_boost);
+        }
+        if (boost) {
+            boost();
+        }
+    }
+
+    void ResourceBase::Finish(LoadState state) {
+        std::vector<std::function<void(bool)>> callbacks;
+        JobHandle loadedHandle;
+        {
+            std::lock_guard<std::mutex> lg(_lock);
+            _state.store(state);
+            callbacks.swap(_callbacks);
+            _boost = nullptr;
+            loadedHandle = _loadedHandle;
+        }
+
+        _state.notify_all();
+        if (_timedWaiters.load() != 0) {
+            auto& slot = WaitSlotOf(this);
+            {
+                // a waiter is either before its check of the state or already asleep
+                std::lock_guard<std::mutex> lg(slot.lock);
+            }
+            slot.cond.notify_all();
+        }
+
+        loadedHandle.Complete();
+        for (auto& callback : callbacks) {
+            callback(state == LoadState::Loaded);
+        }
+    }
 
-};
\ No newline at end of file
+}
\ No newline at end of file
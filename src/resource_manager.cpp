@@ -33,9 +33,7 @@ namespace Rise {
             std::unique_lock ul(_unloadLock);
             _destroying = true;
         }
-        for (const auto& allocator : _allocators) {
-            while(allocator.second.freeAllocations() < allocator.second.capacity()) {}
-        }
+        while (_allocator.allocated() > 0) {}
     }
 
     const std::string ResourceGenerator::metaExtension = ".meta";
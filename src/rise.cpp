@@ -5,6 +5,7 @@
 #include "Rise/loader.h"
 #include "Rise/resource_manager.h"
 #include "Rise/gpu_allocator.h"
+#include "Rise/upload_queue.h"
 #include "Rise/window.h"
 
 #define STB_IMAGE_IMPLEMENTATION
@@ -12,6 +13,7 @@
 
 #include FT_MODULE_H
 
+#include <cstring>
 #include <iostream>
 #include <set>
 #include <unordered_map>
@@ -82,12 +84,19 @@ Core::Core() {
     InitGLFW();
     InitVulkan();
 
-    _loader = new Rise::Loader(8);
+    _uploads = new Rise::UploadQueue();
+
+    _loader = new Rise::Loader(Rise::Loader::config());
     _resources = new Rise::ResourceManager();
     _resourceGenerator = new Rise::ResourceGenerator(*_resources, *_loader);
 
     _resourceGenerator->RegisterBuiltinResources();
 
+    _memoryPressureCallback = GpuAllocator::AddPressureCallback([this](uint32_t, VkDeviceSize) {
+        _resourceGenerator->EvictUnused();
+        _uploads->Staging().Trim();
+    });
+
     if (FT_Init_FreeType(&_freeTypeLibrary))
     {
         Logger().Error("couldn't initialize freeType!");
@@ -283,6 +292,10 @@ void Core::PickPhysicalDevice() {
     if (_vPhysicalDevice == VK_NULL_HANDLE) {
         Logger().Error("failed to find a suitable GPU!");
     }
+
+    // they don't change during the device's life
+    vkGetPhysicalDeviceProperties(_vPhysicalDevice, &_vPhysicalDeviceProperties);
+    vkGetPhysicalDeviceMemoryProperties(_vPhysicalDevice, &_vMemoryProperties);
     
     _queueFamilyIndices = FindQueueFamilies(_vPhysicalDevice, surface);
     
@@ -342,6 +355,21 @@ void Core::AddOptionalExtensions(std::vector<const char*>& deviceExtensions) {
     }
 }
 
+bool Core::IsDeviceExtensionAvailable(const char* extensionName) {
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(_vPhysicalDevice, nullptr, &extensionCount, nullptr);
+
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(_vPhysicalDevice, nullptr, &extensionCount, availableExtensions.data());
+
+    for (const auto& extension : availableExtensions) {
+        if (strcmp(extension.extensionName, extensionName) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
 Core::QueueFamilyIndices Core::FindQueueFamilies(const VkPhysicalDevice& device, const VkSurfaceKHR& surface) {
     QueueFamilyIndices indices;
     
@@ -370,6 +398,24 @@ Core::QueueFamilyIndices Core::FindQueueFamilies(const VkPhysicalDevice& device,
 
         i++;
     }
+
+    // prefer a family made for copies only, then any family the graphics queue doesn't live in
+    for (uint32_t family = 0; family < queueFamilyCount; ++family) {
+        auto flags = queueFamilies[family].queueFlags;
+        if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT) && !(flags & VK_QUEUE_COMPUTE_BIT)) {
+            indices.transferFamily = family;
+            break;
+        }
+    }
+    if (!indices.transferFamily.has_value()) {
+        for (uint32_t family = 0; family < queueFamilyCount; ++family) {
+            auto flags = queueFamilies[family].queueFlags;
+            if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT)) {
+                indices.transferFamily = family;
+                break;
+            }
+        }
+    }
     
     return indices;
 }
@@ -401,6 +447,9 @@ Core::SwapChainSupportDetails Core::QuerySwapChainSupport(const VkPhysicalDevice
 void Core::CreateLogicalDevice() {
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
     std::set<uint32_t> uniqueQueueFamilies = {_queueFamilyIndices.graphicsFamily.value(), _queueFamilyIndices.presentFamily.value()};
+    if (_queueFamilyIndices.transferFamily.has_value()) {
+        uniqueQueueFamilies.insert(_queueFamilyIndices.transferFamily.value());
+    }
 
     float queuePriority = 1.0f;
     for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -421,6 +470,7 @@ void Core::CreateLogicalDevice() {
     deviceFeatures12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
     deviceFeatures12.descriptorIndexing = true;
     deviceFeatures12.runtimeDescriptorArray = true;
+    deviceFeatures12.timelineSemaphore = true;
 
     VkDeviceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -434,6 +484,10 @@ void Core::CreateLogicalDevice() {
     
     std::vector<const char*> deviceExtensions(vulkanDeviceExtensions.begin(), vulkanDeviceExtensions.end());
     //AddOptionalExtensions(deviceExtensions);
+    _memoryBudgetSupported = IsDeviceExtensionAvailable(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    if (_memoryBudgetSupported) {
+        deviceExtensions.emplace_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    }
     createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
     createInfo.ppEnabledExtensionNames = deviceExtensions.data();
 
@@ -450,6 +504,12 @@ void Core::CreateLogicalDevice() {
 
     vkGetDeviceQueue(_vDevice, _queueFamilyIndices.graphicsFamily.value(), 0, &_vGraphicsQueue);
     vkGetDeviceQueue(_vDevice, _queueFamilyIndices.presentFamily.value(), 0, &_vPresentQueue);
+
+    if (_queueFamilyIndices.transferFamily.has_value()) {
+        vkGetDeviceQueue(_vDevice, _queueFamilyIndices.transferFamily.value(), 0, &_vTransferQueue);
+    } else {
+        _vTransferQueue = _vGraphicsQueue;
+    }
 }
 
 void Core::CreateCommandPool() {
@@ -461,12 +521,12 @@ void Core::CreateCommandPool() {
     if (vkCreateCommandPool(_vDevice, &poolInfo, nullptr, &_vCommandPool) != VK_SUCCESS) {
         Logger().Error("failed to create command pool!");
     }
-    if (vkCreateCommandPool(_vDevice, &poolInfo, nullptr, &_vInstantCommandPool) != VK_SUCCESS) {
-        Logger().Error("failed to create instant command pool!");
-    }
 }
 
 Core::~Core() {
+    // resources destroyed on the loader stop waiting for the main thread to run upload callbacks
+    _uploads->EndFrames();
+
     for (auto& pWindow : _sWindows) {
         delete pWindow;
     }
@@ -474,6 +534,18 @@ Core::~Core() {
 
     FT_Done_Library(_freeTypeLibrary);
 
+    GpuAllocator::RemovePressureCallback(_memoryPressureCallback);
+
+    // drops the coroutines still waiting for the main thread, while their resources are alive.
+    // Loads finishing from now on would post more of them after the managers are gone.
+    std::vector<std::function<void()>> posted;
+    {
+        std::lock_guard<std::mutex> lg(_postedLock);
+        _postsClosed = true;
+        posted.swap(_posted);
+    }
+    posted.clear();
+
     delete _resourceGenerator;
     _resourceGenerator = nullptr;
 
@@ -483,10 +555,12 @@ Core::~Core() {
     delete _loader;
     _loader = nullptr;
 
+    delete _uploads;
+    _uploads = nullptr;
+
     std::lock_guard<std::recursive_mutex> lg(_deviceLock);
     GpuAllocator::Destroy();
 
-    vkDestroyCommandPool(_vDevice, _vInstantCommandPool, nullptr);
     vkDestroyCommandPool(_vDevice, _vCommandPool, nullptr);
     vkDestroyDevice(_vDevice, nullptr);
     
@@ -520,10 +594,25 @@ bool Core::DestroyWindow(Window* pWindow) {
     }
     
     delete pWindow;
+
+    // most of the window's nodes are gone now
+    _resources->TrimAllocators();
     
     return true;
 }
 
+void Core::Post(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lg(_postedLock);
+        if (!_postsClosed) {
+            _posted.emplace_back(std::move(task));
+            return;
+        }
+    }
+    // no frame is going to run it, it's dropped outside the lock as it may let resources go
+    task = nullptr;
+}
+
 void Core::Loop() {
     while(!_sWindows.empty()) {
         std::vector<Window*> vShouldClose;
@@ -542,6 +631,18 @@ void Core::Loop() {
             break;
         }
         
+        GpuAllocator::Update();
+        _uploads->Tick();
+
+        std::vector<std::function<void()>> posted;
+        {
+            std::lock_guard<std::mutex> lg(_postedLock);
+            posted.swap(_posted);
+        }
+        for (auto& task : posted) {
+            task();
+        }
+
         for (auto& pWindow : _sWindows) {
             pWindow->LoopStep();
         }
@@ -116,7 +116,8 @@ namespace Rise {
             auto& uniformData = uniformPair.second;
 
             if (uniformData.metadata.SizeOf() > 0) {
-                binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+                // per draw data is suballocated from a frame buffer and picked with a dynamic offset
+                binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
             }
             else if (uniformData.texture2d) {
                 if (uniformData.sampler) {
@@ -149,6 +150,8 @@ namespace Rise {
 
         if (!file.is_open()) {
             Error("failed to open file!");
+            MarkFailed();
+            return;
         }
 
         size_t fileSize = (size_t)file.tellg();
@@ -0,0 +1,80 @@
+//☀Rise☀
+#include "Rise/slab_allocator.h"
+
+#include <algorithm>
+#include <bit>
+#include <new>
+
+namespace Rise {
+
+    SlabAllocator::SlabAllocator(Allocator::Backend backend) {
+        for (size_t i = 0; i < ClassCount; ++i) {
+            auto blockSize = i < SmallClasses
+                ? (i + 1) * SmallStep
+                : (SmallLimit << (i - SmallClasses + 1));
+            auto poolSize = std::clamp<size_t>(RISE_SLAB_POOL_BYTES / blockSize, 1, RISE_ALLOCATOR_POOL_SIZE);
+            _classes[i] = std::make_unique<Allocator>(static_cast<uint32_t>(blockSize), static_cast<uint32_t>(poolSize), backend);
+        }
+    }
+
+    size_t SlabAllocator::ClassIndex(size_t size) {
+        if (size <= SmallLimit) {
+            return size == 0 ? 0 : (size - 1) / SmallStep;
+        }
+        // 1025..2048 -> first large class, 2049..4096 -> second and so on
+        return SmallClasses + std::bit_width(size - 1) - std::bit_width(SmallLimit);
+    }
+
+    void* SlabAllocator::allocate(size_t size) {
+        if (size > LargeLimit) {
+            _heapAllocations.fetch_add(1, std::memory_order_relaxed);
+            return ::operator new(size);
+        }
+
+        return _classes[ClassIndex(size)]->allocate();
+    }
+
+    void SlabAllocator::deallocate(void* ptr, size_t size) {
+        if (size > LargeLimit) {
+            ::operator delete(ptr);
+            _heapAllocations.fetch_sub(1, std::memory_order_relaxed);
+            return;
+        }
+
+        _classes[ClassIndex(size)]->deallocate(ptr);
+    }
+
+    uint32_t SlabAllocator::allocated() const {
+        uint32_t total = _heapAllocations.load(std::memory_order_relaxed);
+        for (const auto& allocator : _classes) {
+            total += allocator->allocated();
+        }
+        return total;
+    }
+
+    std::vector<Allocator::Statistics> SlabAllocator::statistics() const {
+        std::vector<Allocator::Statistics> result;
+        for (const auto& allocator : _classes) {
+            auto statistics = allocator->statistics();
+            if (statistics.capacity > 0) {
+                result.emplace_back(statistics);
+            }
+        }
+        return result;
+    }
+
+    uint32_t SlabAllocator::Trim() {
+        uint32_t released = 0;
+        for (auto& allocator : _classes) {
+            released += allocator->Trim();
+        }
+        return released;
+    }
+
+    void SlabAllocator::SetAutoTrim(float lowWatermark) {
+        for (auto& allocator : _classes) {
+            allocator->SetAutoTrim(lowWatermark);
+        }
+    }
+
+}
@@ -0,0 +1,56 @@
+//☀Rise☀
+#include "Rise/stack_allocator.h"
+
+#include <algorithm>
+#include <new>
+
+namespace Rise {
+
+    StackAllocator::StackAllocator(size_t chunkSize)
+        : _chunkSize(chunkSize) {}
+    StackAllocator::~StackAllocator() {
+        for (auto& chunk : _chunks) {
+            ::operator delete(chunk.data);
+        }
+    }
+
+    void* StackAllocator::TryAllocate(Chunk& chunk, size_t offset, size_t size, size_t alignment) {
+        auto address = reinterpret_cast<uintptr_t>(chunk.data) + offset;
+        auto aligned = (address + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1);
+        auto end = aligned - reinterpret_cast<uintptr_t>(chunk.data) + size;
+        if (end > chunk.size) {
+            return nullptr;
+        }
+
+        _offset = end;
+        return reinterpret_cast<void*>(aligned);
+    }
+
+    void* StackAllocator::allocate(size_t size, size_t alignment) {
+        if (_chunkIndex < _chunks.size()) {
+            if (auto* ptr = TryAllocate(_chunks[_chunkIndex], _offset, size, alignment)) {
+                return ptr;
+            }
+        }
+
+        // chunks kept from previous cycles come first
+        for (++_chunkIndex; _chunkIndex < _chunks.size(); ++_chunkIndex) {
+            if (auto* ptr = TryAllocate(_chunks[_chunkIndex], 0, size, alignment)) {
+                return ptr;
+            }
+        }
+
+        auto& chunk = _chunks.emplace_back();
+        chunk.size = std::max(_chunkSize, size + alignment);
+        chunk.data = reinterpret_cast<uint8_t*>(::operator new(chunk.size));
+        _chunkIndex = _chunks.size() - 1;
+
+        return TryAllocate(chunk, 0, size, alignment);
+    }
+
+    void StackAllocator::Reset() {
+        _chunkIndex = 0;
+        _offset = 0;
+    }
+
+}
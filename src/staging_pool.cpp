@@ -0,0 +1,79 @@
+//☀Rise☀
+#include "Rise/staging_pool.h"
+
+namespace Rise {
+
+    StagingPool::~StagingPool() {
+        Trim();
+    }
+
+    GpuAllocator::Buffer StagingPool::Acquire(VkDeviceSize size) {
+        auto bucket = BucketOf(size);
+        {
+            std::lock_guard<std::mutex> lg(_lock);
+            if (bucket != Unpooled && !_freeBuffers[bucket].empty()) {
+                auto buffer = _freeBuffers[bucket].back();
+                _freeBuffers[bucket].pop_back();
+                _bucketByBuffer.emplace(buffer.vBuffer(), bucket);
+                return buffer;
+            }
+        }
+
+        auto bufferSize = bucket != Unpooled ? VkDeviceSize(RISE_STAGING_POOL_MIN_SIZE) << bucket : size;
+        auto buffer = GpuAllocator::CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        if (buffer.vBuffer() == VK_NULL_HANDLE) {
+            return buffer;
+        }
+
+        std::lock_guard<std::mutex> lg(_lock);
+        _bucketByBuffer.emplace(buffer.vBuffer(), bucket);
+        return buffer;
+    }
+
+    void StagingPool::Release(GpuAllocator::Buffer buffer) {
+        {
+            std::lock_guard<std::mutex> lg(_lock);
+            auto it = _bucketByBuffer.find(buffer.vBuffer());
+            if (it == _bucketByBuffer.end()) {
+                return;
+            }
+
+            auto bucket = it->second;
+            _bucketByBuffer.erase(it);
+
+            if (bucket != Unpooled && _freeBuffers[bucket].size() < RISE_STAGING_POOL_BUCKET_CAPACITY) {
+                _freeBuffers[bucket].emplace_back(buffer);
+                return;
+            }
+        }
+
+        GpuAllocator::DestroyBuffer(buffer);
+    }
+
+    uint32_t StagingPool::Trim() {
+        std::vector<GpuAllocator::Buffer> buffers;
+        {
+            std::lock_guard<std::mutex> lg(_lock);
+            for (auto& freeBuffers : _freeBuffers) {
+                buffers.insert(buffers.end(), freeBuffers.begin(), freeBuffers.end());
+                freeBuffers.clear();
+            }
+        }
+
+        for (auto& buffer : buffers) {
+            GpuAllocator::DestroyBuffer(buffer);
+        }
+        return static_cast<uint32_t>(buffers.size());
+    }
+
+    uint32_t StagingPool::BucketOf(VkDeviceSize size) {
+        uint32_t bucket = 0;
+        for (auto bucketSize = VkDeviceSize(RISE_STAGING_POOL_MIN_SIZE); bucketSize < size; bucketSize *= 2) {
+            if (++bucket == Unpooled) {
+                break;
+            }
+        }
+        return bucket;
+    }
+
+}
@@ -0,0 +1,25 @@
+//☀Rise☀
+#include "Rise/task.h"
+
+#include "Rise/rise.h"
+#include "Rise/loader.h"
+
+namespace Rise {
+
+    void Resume(ResumeOn resumeOn, std::coroutine_handle<Task::promise_type> handle) {
+        auto resumption = std::make_shared<Resumption>(handle);
+        auto resume = [resumption]() {
+            (*resumption)();
+        };
+
+        switch (resumeOn) {
+        case ResumeOn::Loader:
+            Instance()->Loader().AddJob(std::move(resume));
+            break;
+        case ResumeOn::MainThread:
+            Instance()->Post(std::move(resume));
+            break;
+        }
+    }
+
+}
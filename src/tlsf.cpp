@@ -0,0 +1,339 @@
+//☀Rise☀
+#include "Rise/tlsf.h"
+
+#include <algorithm>
+#include <bit>
+
+namespace Rise {
+
+    Tlsf::Tlsf() {
+        for (auto& heads : _heads) {
+            heads.fill(Null);
+        }
+    }
+
+    // sizes below SlCount are mapped linearly into the first level
+    void Tlsf::MappingInsert(uint64_t size, uint32_t& fl, uint32_t& sl) {
+        if (size < SlCount) {
+            fl = 0;
+            sl = static_cast<uint32_t>(size);
+            return;
+        }
+
+        auto msb = static_cast<uint32_t>(std::bit_width(size)) - 1;
+        fl = msb - SlBits + 1;
+        sl = static_cast<uint32_t>(size >> (msb - SlBits)) ^ SlCount;
+    }
+
+    // rounds size up to the next list, so that any node found in it is big enough
+    void Tlsf::MappingSearch(uint64_t size, uint32_t& fl, uint32_t& sl) {
+        if (size >= SlCount) {
+            auto msb = static_cast<uint32_t>(std::bit_width(size)) - 1;
+            auto round = (uint64_t(1) << (msb - SlBits)) - 1;
+            if (size <= std::numeric_limits<uint64_t>::max() - round) {
+                size += round;
+            }
+        }
+        MappingInsert(size, fl, sl);
+    }
+
+    uint32_t Tlsf::FindSuitable(uint32_t fl, uint32_t sl) const {
+        if (fl >= FlCount) {
+            return Null;
+        }
+
+        auto slMap = sl < SlCount ? _slBitmaps[fl] & (~0u << sl) : 0u;
+        if (slMap == 0) {
+            auto flMap = fl + 1 < 64 ? _flBitmap & (~uint64_t(0) << (fl + 1)) : 0;
+            if (flMap == 0) {
+                return Null;
+            }
+
+            fl = static_cast<uint32_t>(std::countr_zero(flMap));
+            slMap = _slBitmaps[fl];
+        }
+
+        sl = static_cast<uint32_t>(std::countr_zero(slMap));
+        return _heads[fl][sl];
+    }
+
+    void Tlsf::InsertFree(uint32_t index) {
+        auto& node = _nodes[index];
+        uint32_t fl, sl;
+        MappingInsert(node.size, fl, sl);
+
+        node.free = true;
+        node.prevFree = Null;
+        node.nextFree = _heads[fl][sl];
+        if (node.nextFree != Null) {
+            _nodes[node.nextFree].prevFree = index;
+        }
+        _heads[fl][sl] = index;
+
+        _flBitmap |= uint64_t(1) << fl;
+        _slBitmaps[fl] |= 1u << sl;
+    }
+
+    void Tlsf::RemoveFree(uint32_t index) {
+        auto& node = _nodes[index];
+        uint32_t fl, sl;
+        MappingInsert(node.size, fl, sl);
+
+        if (node.prevFree != Null) {
+            _nodes[node.prevFree].nextFree = node.nextFree;
+        }
+        else {
+            _heads[fl][sl] = node.nextFree;
+        }
+        if (node.nextFree != Null) {
+            _nodes[node.nextFree].prevFree = node.prevFree;
+        }
+
+        if (_heads[fl][sl] == Null) {
+            _slBitmaps[fl] &= ~(1u << sl);
+            if (_slBitmaps[fl] == 0) {
+                _flBitmap &= ~(uint64_t(1) << fl);
+            }
+        }
+
+        node.free = false;
+        node.prevFree = Null;
+        node.nextFree = Null;
+    }
+
+    void Tlsf::AttachFree(uint32_t index) {
+        if (_regions[_nodes[index].region].locked) {
+            _nodes[index].free = true;
+            return;
+        }
+        InsertFree(index);
+    }
+
+    void Tlsf::DetachFree(uint32_t index) {
+        if (_regions[_nodes[index].region].locked) {
+            _nodes[index].free = false;
+            return;
+        }
+        RemoveFree(index);
+    }
+
+    uint32_t Tlsf::NewNode() {
+        if (!_unusedNodes.empty()) {
+            auto index = _unusedNodes.back();
+            _unusedNodes.pop_back();
+            _nodes[index] = {};
+            return index;
+        }
+
+        _nodes.emplace_back();
+        return static_cast<uint32_t>(_nodes.size() - 1);
+    }
+
+    void Tlsf::ReleaseNode(uint32_t index) {
+        // looks free, so that a stale handle is ignored by Free
+        _nodes[index].free = true;
+        _unusedNodes.emplace_back(index);
+    }
+
+    uint32_t Tlsf::AddRegion(uint64_t size) {
+        uint32_t regionIndex;
+        if (!_unusedRegions.empty()) {
+            regionIndex = _unusedRegions.back();
+            _unusedRegions.pop_back();
+        }
+        else {
+            regionIndex = static_cast<uint32_t>(_regions.size());
+            _regions.emplace_back();
+        }
+
+        auto index = NewNode();
+        auto& node = _nodes[index];
+        node.offset = 0;
+        node.size = size;
+        node.region = regionIndex;
+
+        _regions[regionIndex] = { size, 0, index, false };
+        InsertFree(index);
+
+        return regionIndex;
+    }
+
+    void Tlsf::RemoveRegion(uint32_t region) {
+        auto& regionData = _regions[region];
+        if (regionData.first == Null || regionData.used != 0) {
+            return;
+        }
+
+        // nothing is used, so everything has been merged into the first node
+        DetachFree(regionData.first);
+        ReleaseNode(regionData.first);
+
+        regionData = {};
+        _unusedRegions.emplace_back(region);
+    }
+
+    void Tlsf::LockRegion(uint32_t region) {
+        auto& regionData = _regions[region];
+        if (regionData.first == Null || regionData.locked) {
+            return;
+        }
+
+        for (auto index = regionData.first; index != Null; index = _nodes[index].nextPhysical) {
+            if (_nodes[index].free) {
+                RemoveFree(index);
+                _nodes[index].free = true;
+            }
+        }
+        regionData.locked = true;
+    }
+
+    void Tlsf::UnlockRegion(uint32_t region) {
+        auto& regionData = _regions[region];
+        if (regionData.first == Null || !regionData.locked) {
+            return;
+        }
+
+        regionData.locked = false;
+        for (auto index = regionData.first; index != Null; index = _nodes[index].nextPhysical) {
+            if (_nodes[index].free) {
+                InsertFree(index);
+            }
+        }
+    }
+
+    void Tlsf::SplitTail(uint32_t index, uint64_t size) {
+        if (_nodes[index].size == size) {
+            return;
+        }
+
+        auto tailIndex = NewNode();
+        auto& node = _nodes[index];
+        auto& tail = _nodes[tailIndex];
+
+        tail.offset = node.offset + size;
+        tail.size = node.size - size;
+        tail.region = node.region;
+        tail.prevPhysical = index;
+        tail.nextPhysical = node.nextPhysical;
+        if (tail.nextPhysical != Null) {
+            _nodes[tail.nextPhysical].prevPhysical = tailIndex;
+        }
+
+        node.size = size;
+        node.nextPhysical = tailIndex;
+
+        // physical neighbour after the tail is used, otherwise it would have been merged earlier
+        InsertFree(tailIndex);
+    }
+
+    bool Tlsf::Fits(uint32_t index, uint64_t size, uint64_t alignment) const {
+        const auto& node = _nodes[index];
+        auto alignedOffset = (node.offset + alignment - 1) & ~(alignment - 1);
+        return alignedOffset + size <= node.offset + node.size;
+    }
+
+    bool Tlsf::Allocate(uint64_t size, uint64_t alignment, Allocation& allocation) {
+        if (size == 0) {
+            size = 1;
+        }
+        if (alignment == 0) {
+            alignment = 1;
+        }
+
+        uint32_t fl, sl;
+        MappingSearch(size, fl, sl);
+        auto index = FindSuitable(fl, sl);
+
+        // the first candidate is often aligned well enough already,
+        // otherwise looking for a node which fits the size whatever its alignment is
+        if (index != Null && !Fits(index, size, alignment)) {
+            auto searchSize = size + alignment - 1;
+            if (searchSize < size) {
+                return false;
+            }
+
+            MappingSearch(searchSize, fl, sl);
+            index = FindSuitable(fl, sl);
+        }
+        if (index == Null) {
+            return false;
+        }
+
+        RemoveFree(index);
+
+        auto& node = _nodes[index];
+        auto alignedOffset = (node.offset + alignment - 1) & ~(alignment - 1);
+        auto padding = alignedOffset - node.offset;
+
+        if (padding > 0) {
+            // front padding stays free as its own node, the allocation moves to the second half
+            SplitTail(index, padding);
+            auto paddingIndex = index;
+            index = _nodes[paddingIndex].nextPhysical;
+            RemoveFree(index);
+            InsertFree(paddingIndex);
+        }
+
+        SplitTail(index, size);
+
+        auto& allocated = _nodes[index];
+        _regions[allocated.region].used += allocated.size;
+
+        allocation.handle = index;
+        allocation.region = allocated.region;
+        allocation.offset = allocated.offset;
+        allocation.size = allocated.size;
+        return true;
+    }
+
+    void Tlsf::Free(Handle handle) {
+        if (handle == InvalidHandle || handle >= _nodes.size() || _nodes[handle].free) {
+            return;
+        }
+
+        auto index = handle;
+        _regions[_nodes[index].region].used -= _nodes[index].size;
+
+        if (auto prev = _nodes[index].prevPhysical; prev != Null && _nodes[prev].free) {
+            DetachFree(prev);
+
+            auto& prevNode = _nodes[prev];
+            auto& node = _nodes[index];
+            prevNode.size += node.size;
+            prevNode.nextPhysical = node.nextPhysical;
+            if (prevNode.nextPhysical != Null) {
+                _nodes[prevNode.nextPhysical].prevPhysical = prev;
+            }
+
+            ReleaseNode(index);
+            index = prev;
+        }
+
+        if (auto next = _nodes[index].nextPhysical; next != Null && _nodes[next].free) {
+            DetachFree(next);
+
+            auto& node = _nodes[index];
+            auto& nextNode = _nodes[next];
+            node.size += nextNode.size;
+            node.nextPhysical = nextNode.nextPhysical;
+            if (node.nextPhysical != Null) {
+                _nodes[node.nextPhysical].prevPhysical = index;
+            }
+
+            ReleaseNode(next);
+        }
+
+        AttachFree(index);
+    }
+
+    uint64_t Tlsf::regionLargestFree(uint32_t region) const {
+        uint64_t largest = 0;
+        for (auto index = _regions[region].first; index != Null; index = _nodes[index].nextPhysical) {
+            if (_nodes[index].free) {
+                largest = std::max(largest, _nodes[index].size);
+            }
+        }
+        return largest;
+    }
+
+}
@@ -4,6 +4,7 @@
 #include "Rise/window.h"
 #include "Rise/gpu_allocator.h"
 #include "Rise/rise.h"
+#include "Rise/logger.h"
 
 namespace Rise {
 
@@ -26,17 +27,24 @@ namespace Rise {
         poolData.count += count;
     }
 
-    void BufferUniformSetter::InitBuffer(VkDeviceSize bufferSize) {
-        uniformBuffer = GpuAllocator::CreateBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-    }
+    void BufferUniformSetter::Init(VkDescriptorSet vDescriptorSet, uint32_t binding, const std::vector<uint8_t>& data, GpuStackAllocator& uploadStack) {
+        auto alignment = Instance()->_vPhysicalDeviceProperties.limits.minUniformBufferOffsetAlignment;
+        _allocation = uploadStack.Allocate(data.size(), alignment);
+        if (!_allocation) {
+            Instance()->Logger().Error("failed to allocate uniform buffer!");
+            return;
+        }
 
-    void BufferUniformSetter::Init(VkDescriptorSet vDescriptorSet, uint32_t binding, VkDeviceSize size) {
-        InitBuffer(size);
+        memcpy(_allocation.data, data.data(), data.size());
+
+        WriteDescriptor(vDescriptorSet, binding, _allocation.vBuffer, _allocation.size);
+    }
 
+    void BufferUniformSetter::WriteDescriptor(VkDescriptorSet vDescriptorSet, uint32_t binding, VkBuffer vBuffer, VkDeviceSize range) {
         VkDescriptorBufferInfo bufferInfo{};
-        bufferInfo.buffer = uniformBuffer.vBuffer();
+        bufferInfo.buffer = vBuffer;
         bufferInfo.offset = 0;
-        bufferInfo.range = size;
+        bufferInfo.range = range;
 
         VkWriteDescriptorSet descriptorWrite{};
         descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
@@ -52,16 +60,6 @@ namespace Rise {
         vkUpdateDescriptorSets(Instance()->_vDevice, 1, &descriptorWrite, 0, nullptr);
     }
 
-    void BufferUniformSetter::UpdateUniformBuffer(const std::vector<uint8_t>& data) {
-        auto ptrData = uniformBuffer.MapMemory();
-        memcpy(ptrData, data.data(), data.size());
-    }
-
-    void BufferUniformSetter::Destroy() {
-        GpuAllocator::DestroyBuffer(uniformBuffer);
-    }
-
-
     void ImageUniformSetter::Init(VkDescriptorSet vDescriptorSet, uint32_t binding) {
         if (!_image->IsLoaded()) {
             return;
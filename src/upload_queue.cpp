@@ -0,0 +1,590 @@
+//☀Rise☀
+#include "Rise/upload_queue.h"
+
+#include "Rise/rise.h"
+#include "Rise/logger.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace Rise {
+
+    UploadQueue::UploadQueue() {
+        auto& families = Instance()->_queueFamilyIndices;
+        _graphicsFamily = families.graphicsFamily.value();
+        _transferFamily = families.transferFamily.value_or(_graphicsFamily);
+
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        poolInfo.queueFamilyIndex = _transferFamily;
+
+        if (vkCreateCommandPool(Instance()->_vDevice, &poolInfo, nullptr, &_vCommandPool) != VK_SUCCESS) {
+            Instance()->Logger().Error("failed to create upload command pool!");
+        }
+
+        VkSemaphoreTypeCreateInfo typeInfo{};
+        typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        typeInfo.initialValue = 0;
+
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        semaphoreInfo.pNext = &typeInfo;
+
+        if (vkCreateSemaphore(Instance()->_vDevice, &semaphoreInfo, nullptr, &_vTimeline) != VK_SUCCESS) {
+            Instance()->Logger().Error("failed to create upload timeline semaphore!");
+        }
+
+        if (!SeparateTransfer()) {
+            return;
+        }
+
+        poolInfo.queueFamilyIndex = _graphicsFamily;
+        if (vkCreateCommandPool(Instance()->_vDevice, &poolInfo, nullptr, &_vAcquirePool) != VK_SUCCESS) {
+            Instance()->Logger().Error("failed to create upload acquire command pool!");
+        }
+
+        if (vkCreateSemaphore(Instance()->_vDevice, &semaphoreInfo, nullptr, &_vTransferTimeline) != VK_SUCCESS) {
+            Instance()->Logger().Error("failed to create transfer timeline semaphore!");
+        }
+    }
+
+    UploadQueue::~UploadQueue() {
+        Submit();
+
+        Ticket lastTicket;
+        {
+            std::lock_guard<std::mutex> lg(_pendingLock);
+            lastTicket = _nextTicket - 1;
+        }
+        Wait(lastTicket);
+
+        vkDestroySemaphore(Instance()->_vDevice, _vTimeline, nullptr);
+        vkDestroyCommandPool(Instance()->_vDevice, _vCommandPool, nullptr);
+
+        if (SeparateTransfer()) {
+            vkDestroySemaphore(Instance()->_vDevice, _vTransferTimeline, nullptr);
+            vkDestroyCommandPool(Instance()->_vDevice, _vAcquirePool, nullptr);
+        }
+    }
+
+    UploadQueue::Ticket UploadQueue::CopyBuffer(GpuAllocator::Buffer srcBuffer, GpuAllocator::Buffer dstBuffer, VkDeviceSize size, Callback onComplete) {
+        Copy copy;
+        copy.srcBuffer = srcBuffer;
+        copy.dstBuffer = dstBuffer;
+        copy.size = size;
+
+        return Emplace(copy, std::move(onComplete));
+    }
+
+    UploadQueue::Ticket UploadQueue::CopyBufferToImage(GpuAllocator::Buffer srcBuffer, GpuAllocator::Image dstImage, const VkExtent3D& extent, Callback onComplete) {
+        Copy copy;
+        copy.srcBuffer = srcBuffer;
+        copy.dstImage = dstImage;
+        copy.extent = extent;
+
+        return Emplace(copy, std::move(onComplete));
+    }
+
+    UploadQueue::Ticket UploadQueue::MoveBuffer(GpuAllocator::Buffer srcBuffer, GpuAllocator::Buffer dstBuffer, VkDeviceSize size, Callback onComplete) {
+        Copy copy;
+        copy.move = true;
+        copy.srcBuffer = srcBuffer;
+        copy.dstBuffer = dstBuffer;
+        copy.size = size;
+
+        return Emplace(copy, std::move(onComplete));
+    }
+
+    UploadQueue::Ticket UploadQueue::MoveImage(GpuAllocator::Image srcImage, GpuAllocator::Image dstImage, const VkExtent3D& extent, Callback onComplete) {
+        Copy copy;
+        copy.move = true;
+        copy.srcImage = srcImage;
+        copy.dstImage = dstImage;
+        copy.extent = extent;
+
+        return Emplace(copy, std::move(onComplete));
+    }
+
+    UploadQueue::Ticket UploadQueue::Emplace(const Copy& copy, Callback&& onComplete) {
+        std::lock_guard<std::mutex> lg(_pendingLock);
+
+        _pendingCopies.emplace_back(copy);
+        if (onComplete) {
+            _pendingCallbacks.emplace_back(std::move(onComplete));
+        }
+
+        return _nextTicket;
+    }
+
+    void UploadQueue::Tick() {
+        Collect();
+        Submit();
+    }
+
+    void UploadQueue::Wait(Ticket ticket) {
+        if (ticket == 0) {
+            return;
+        }
+
+        bool pending;
+        {
+            std::lock_guard<std::mutex> lg(_pendingLock);
+            pending = ticket >= _nextTicket;
+        }
+        if (pending) {
+            Submit();
+        }
+
+        VkSemaphoreWaitInfo waitInfo{};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &_vTimeline;
+        waitInfo.pValues = &ticket;
+
+        vkWaitSemaphores(Instance()->_vDevice, &waitInfo, std::numeric_limits<uint64_t>::max());
+
+        if (std::this_thread::get_id() != _tickThread) {
+            std::unique_lock<std::mutex> ul(_collectedLock);
+            _collectedCond.wait(ul, [this, ticket]() { return _collected >= ticket || _framesEnded; });
+            if (_collected >= ticket) {
+                return;
+            }
+        }
+
+        Collect();
+    }
+
+    void UploadQueue::EndFrames() {
+        std::lock_guard<std::mutex> lg(_collectedLock);
+        _framesEnded = true;
+        _collectedCond.notify_all();
+    }
+
+    bool UploadQueue::IsComplete(Ticket ticket) const {
+        uint64_t value = 0;
+        vkGetSemaphoreCounterValue(Instance()->_vDevice, _vTimeline, &value);
+        return ticket <= value;
+    }
+
+    void UploadQueue::Submit() {
+        std::lock_guard<std::mutex> submitLg(_submitLock);
+
+        std::vector<Copy> copies;
+        Batch batch;
+        {
+            std::lock_guard<std::mutex> lg(_pendingLock);
+            if (_pendingCopies.empty()) {
+                return;
+            }
+
+            copies.swap(_pendingCopies);
+            batch.callbacks.swap(_pendingCallbacks);
+            batch.ticket = _nextTicket++;
+        }
+
+        std::vector<Copy> uploads;
+        std::vector<Copy> moves;
+        for (auto& copy : copies) {
+            (copy.move ? moves : uploads).emplace_back(copy);
+        }
+
+        std::lock_guard<std::recursive_mutex> lg(Instance()->_deviceLock);
+
+        if (!SeparateTransfer()) {
+            batch.vCommandBuffer = AllocateCommandBuffer(_vCommandPool);
+
+            Begin(batch.vCommandBuffer);
+            Record(batch.vCommandBuffer, uploads);
+            RecordMoves(batch.vCommandBuffer, moves);
+            vkEndCommandBuffer(batch.vCommandBuffer);
+
+            VkTimelineSemaphoreSubmitInfo timelineInfo{};
+            timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+            timelineInfo.signalSemaphoreValueCount = 1;
+            timelineInfo.pSignalSemaphoreValues = &batch.ticket;
+
+            VkSubmitInfo submitInfo{};
+            submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            submitInfo.pNext = &timelineInfo;
+            submitInfo.commandBufferCount = 1;
+            submitInfo.pCommandBuffers = &batch.vCommandBuffer;
+            submitInfo.signalSemaphoreCount = 1;
+            submitInfo.pSignalSemaphores = &_vTimeline;
+
+            if (vkQueueSubmit(Instance()->_vGraphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+                Instance()->Logger().Error("failed to submit upload batch!");
+            }
+
+            _inFlight.emplace_back(std::move(batch));
+            return;
+        }
+
+        if (!uploads.empty()) {
+            batch.vCommandBuffer = AllocateCommandBuffer(_vCommandPool);
+
+            Begin(batch.vCommandBuffer);
+            Record(batch.vCommandBuffer, uploads);
+            vkEndCommandBuffer(batch.vCommandBuffer);
+
+            VkTimelineSemaphoreSubmitInfo transferTimelineInfo{};
+            transferTimelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+            transferTimelineInfo.signalSemaphoreValueCount = 1;
+            transferTimelineInfo.pSignalSemaphoreValues = &batch.ticket;
+
+            VkSubmitInfo transferInfo{};
+            transferInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            transferInfo.pNext = &transferTimelineInfo;
+            transferInfo.commandBufferCount = 1;
+            transferInfo.pCommandBuffers = &batch.vCommandBuffer;
+            transferInfo.signalSemaphoreCount = 1;
+            transferInfo.pSignalSemaphores = &_vTransferTimeline;
+
+            if (vkQueueSubmit(Instance()->_vTransferQueue, 1, &transferInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+                Instance()->Logger().Error("failed to submit upload batch!");
+            }
+        }
+
+        // the graphics queue takes the uploads over once they are done and runs the moves
+        batch.vAcquireCommandBuffer = AllocateCommandBuffer(_vAcquirePool);
+
+        Begin(batch.vAcquireCommandBuffer);
+        RecordAcquire(batch.vAcquireCommandBuffer, uploads);
+        RecordMoves(batch.vAcquireCommandBuffer, moves);
+        vkEndCommandBuffer(batch.vAcquireCommandBuffer);
+
+        VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+        VkTimelineSemaphoreSubmitInfo acquireTimelineInfo{};
+        acquireTimelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        acquireTimelineInfo.signalSemaphoreValueCount = 1;
+        acquireTimelineInfo.pSignalSemaphoreValues = &batch.ticket;
+
+        VkSubmitInfo acquireInfo{};
+        acquireInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        acquireInfo.pNext = &acquireTimelineInfo;
+        acquireInfo.commandBufferCount = 1;
+        acquireInfo.pCommandBuffers = &batch.vAcquireCommandBuffer;
+        acquireInfo.signalSemaphoreCount = 1;
+        acquireInfo.pSignalSemaphores = &_vTimeline;
+
+        if (!uploads.empty()) {
+            acquireTimelineInfo.waitSemaphoreValueCount = 1;
+            acquireTimelineInfo.pWaitSemaphoreValues = &batch.ticket;
+
+            acquireInfo.waitSemaphoreCount = 1;
+            acquireInfo.pWaitSemaphores = &_vTransferTimeline;
+            acquireInfo.pWaitDstStageMask = &waitStage;
+        }
+
+        if (vkQueueSubmit(Instance()->_vGraphicsQueue, 1, &acquireInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+            Instance()->Logger().Error("failed to submit upload acquire batch!");
+        }
+
+        _inFlight.emplace_back(std::move(batch));
+    }
+
+    VkCommandBuffer UploadQueue::AllocateCommandBuffer(VkCommandPool vCommandPool) {
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandPool = vCommandPool;
+        allocInfo.commandBufferCount = 1;
+
+        VkCommandBuffer vCommandBuffer = VK_NULL_HANDLE;
+        vkAllocateCommandBuffers(Instance()->_vDevice, &allocInfo, &vCommandBuffer);
+
+        return vCommandBuffer;
+    }
+
+    void UploadQueue::Begin(VkCommandBuffer vCommandBuffer) {
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        vkBeginCommandBuffer(vCommandBuffer, &beginInfo);
+    }
+
+    void UploadQueue::Record(VkCommandBuffer vCommandBuffer, const std::vector<Copy>& copies) {
+        if (copies.empty()) {
+            return;
+        }
+
+        VkImageSubresourceRange range;
+        range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        range.baseMipLevel = 0;
+        range.levelCount = 1;
+        range.baseArrayLayer = 0;
+        range.layerCount = 1;
+
+        std::vector<VkImageMemoryBarrier> toTransfer;
+        for (auto& copy : copies) {
+            if (copy.dstImage.vImage() == VK_NULL_HANDLE) {
+                continue;
+            }
+
+            auto& barrier = toTransfer.emplace_back();
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.image = copy.dstImage.vImage();
+            barrier.subresourceRange = range;
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        }
+
+        //barrier all images into the transfer-receive layout at once
+        if (!toTransfer.empty()) {
+            vkCmdPipelineBarrier(vCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                0, nullptr, 0, nullptr, static_cast<uint32_t>(toTransfer.size()), toTransfer.data());
+        }
+
+        for (auto& copy : copies) {
+            if (copy.dstImage.vImage() == VK_NULL_HANDLE) {
+                VkBufferCopy copyRegion{};
+                copyRegion.srcOffset = 0;
+                copyRegion.dstOffset = 0;
+                copyRegion.size = copy.size;
+                vkCmdCopyBuffer(vCommandBuffer, copy.srcBuffer.vBuffer(), copy.dstBuffer.vBuffer(), 1, &copyRegion);
+                continue;
+            }
+
+            VkBufferImageCopy copyRegion = {};
+            copyRegion.bufferOffset = 0;
+            copyRegion.bufferRowLength = 0;
+            copyRegion.bufferImageHeight = 0;
+
+            copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            copyRegion.imageSubresource.mipLevel = 0;
+            copyRegion.imageSubresource.baseArrayLayer = 0;
+            copyRegion.imageSubresource.layerCount = 1;
+            copyRegion.imageOffset = {};
+            copyRegion.imageExtent = copy.extent;
+
+            vkCmdCopyBufferToImage(vCommandBuffer, copy.srcBuffer.vBuffer(), copy.dstImage.vImage(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
+        }
+
+        std::vector<VkImageMemoryBarrier> toReadable(toTransfer);
+        for (auto& barrier : toReadable) {
+            barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        }
+
+        if (SeparateTransfer()) {
+            // release everything to the graphics family, the acquire half is recorded by RecordAcquire
+            std::vector<VkBufferMemoryBarrier> bufferReleases;
+            for (auto& copy : copies) {
+                if (copy.dstImage.vImage() != VK_NULL_HANDLE) {
+                    continue;
+                }
+
+                auto& barrier = bufferReleases.emplace_back();
+                barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+                barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                barrier.dstAccessMask = 0;
+                barrier.srcQueueFamilyIndex = _transferFamily;
+                barrier.dstQueueFamilyIndex = _graphicsFamily;
+                barrier.buffer = copy.dstBuffer.vBuffer();
+                barrier.offset = 0;
+                barrier.size = VK_WHOLE_SIZE;
+            }
+
+            for (auto& barrier : toReadable) {
+                barrier.dstAccessMask = 0;
+                barrier.srcQueueFamilyIndex = _transferFamily;
+                barrier.dstQueueFamilyIndex = _graphicsFamily;
+            }
+
+            vkCmdPipelineBarrier(vCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+                0, nullptr, static_cast<uint32_t>(bufferReleases.size()), bufferReleases.data(), static_cast<uint32_t>(toReadable.size()), toReadable.data());
+            return;
+        }
+
+        // later submissions on the queue read what was written here without waiting on the semaphore,
+        // so the writes are made visible to them by the barrier itself
+        VkMemoryBarrier memoryBarrier{};
+        memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        memoryBarrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+
+        vkCmdPipelineBarrier(vCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+            1, &memoryBarrier, 0, nullptr, static_cast<uint32_t>(toReadable.size()), toReadable.data());
+    }
+
+    void UploadQueue::RecordAcquire(VkCommandBuffer vCommandBuffer, const std::vector<Copy>& copies) {
+        if (copies.empty()) {
+            return;
+        }
+
+        VkImageSubresourceRange range;
+        range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        range.baseMipLevel = 0;
+        range.levelCount = 1;
+        range.baseArrayLayer = 0;
+        range.layerCount = 1;
+
+        // has to match the release barriers recorded on the transfer queue
+        std::vector<VkBufferMemoryBarrier> bufferAcquires;
+        std::vector<VkImageMemoryBarrier> imageAcquires;
+        for (auto& copy : copies) {
+            if (copy.dstImage.vImage() == VK_NULL_HANDLE) {
+                auto& barrier = bufferAcquires.emplace_back();
+                barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+                barrier.srcAccessMask = 0;
+                barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT;
+                barrier.srcQueueFamilyIndex = _transferFamily;
+                barrier.dstQueueFamilyIndex = _graphicsFamily;
+                barrier.buffer = copy.dstBuffer.vBuffer();
+                barrier.offset = 0;
+                barrier.size = VK_WHOLE_SIZE;
+                continue;
+            }
+
+            auto& barrier = imageAcquires.emplace_back();
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            barrier.srcQueueFamilyIndex = _transferFamily;
+            barrier.dstQueueFamilyIndex = _graphicsFamily;
+            barrier.image = copy.dstImage.vImage();
+            barrier.subresourceRange = range;
+        }
+
+        vkCmdPipelineBarrier(vCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+            VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+            0, nullptr, static_cast<uint32_t>(bufferAcquires.size()), bufferAcquires.data(), static_cast<uint32_t>(imageAcquires.size()), imageAcquires.data());
+    }
+
+    void UploadQueue::RecordMoves(VkCommandBuffer vCommandBuffer, const std::vector<Copy>& moves) {
+        if (moves.empty()) {
+            return;
+        }
+
+        VkImageSubresourceRange range;
+        range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        range.baseMipLevel = 0;
+        range.levelCount = 1;
+        range.baseArrayLayer = 0;
+        range.layerCount = 1;
+
+        std::vector<VkImageMemoryBarrier> toTransfer;
+        for (auto& move : moves) {
+            if (move.srcImage.vImage() == VK_NULL_HANDLE) {
+                continue;
+            }
+
+            // earlier frames may still sample the source
+            auto& srcBarrier = toTransfer.emplace_back();
+            srcBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            srcBarrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            srcBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+            srcBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            srcBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            srcBarrier.image = move.srcImage.vImage();
+            srcBarrier.subresourceRange = range;
+            srcBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            srcBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+            auto& dstBarrier = toTransfer.emplace_back(srcBarrier);
+            dstBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            dstBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            dstBarrier.image = move.dstImage.vImage();
+            dstBarrier.srcAccessMask = 0;
+            dstBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        }
+
+        if (!toTransfer.empty()) {
+            vkCmdPipelineBarrier(vCommandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                0, nullptr, 0, nullptr, static_cast<uint32_t>(toTransfer.size()), toTransfer.data());
+        }
+
+        for (auto& move : moves) {
+            if (move.srcImage.vImage() == VK_NULL_HANDLE) {
+                VkBufferCopy copyRegion{};
+                copyRegion.srcOffset = 0;
+                copyRegion.dstOffset = 0;
+                copyRegion.size = move.size;
+                vkCmdCopyBuffer(vCommandBuffer, move.srcBuffer.vBuffer(), move.dstBuffer.vBuffer(), 1, &copyRegion);
+                continue;
+            }
+
+            VkImageCopy copyRegion{};
+            copyRegion.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            copyRegion.srcSubresource.mipLevel = 0;
+            copyRegion.srcSubresource.baseArrayLayer = 0;
+            copyRegion.srcSubresource.layerCount = 1;
+            copyRegion.dstSubresource = copyRegion.srcSubresource;
+            copyRegion.extent = move.extent;
+
+            vkCmdCopyImage(vCommandBuffer, move.srcImage.vImage(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                move.dstImage.vImage(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
+        }
+
+        // frames recorded before the owners learn about the move keep sampling the sources
+        std::vector<VkImageMemoryBarrier> toReadable(toTransfer);
+        for (auto& barrier : toReadable) {
+            barrier.oldLayout = barrier.newLayout;
+            barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            barrier.srcAccessMask = barrier.dstAccessMask == VK_ACCESS_TRANSFER_WRITE_BIT ? VK_ACCESS_TRANSFER_WRITE_BIT : 0;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        }
+
+        VkMemoryBarrier memoryBarrier{};
+        memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        memoryBarrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+
+        vkCmdPipelineBarrier(vCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+            1, &memoryBarrier, 0, nullptr, static_cast<uint32_t>(toReadable.size()), toReadable.data());
+    }
+
+    void UploadQueue::Collect() {
+        std::lock_guard<std::recursive_mutex> completionLg(_completionLock);
+
+        std::vector<Callback> callbacks;
+        Ticket collected = 0;
+        {
+            std::lock_guard<std::mutex> lg(_submitLock);
+
+            uint64_t value = 0;
+            vkGetSemaphoreCounterValue(Instance()->_vDevice, _vTimeline, &value);
+
+            while (!_inFlight.empty() && _inFlight.front().ticket <= value) {
+                auto& batch = _inFlight.front();
+
+                if (batch.vCommandBuffer != VK_NULL_HANDLE) {
+                    vkFreeCommandBuffers(Instance()->_vDevice, _vCommandPool, 1, &batch.vCommandBuffer);
+                }
+                if (batch.vAcquireCommandBuffer != VK_NULL_HANDLE) {
+                    vkFreeCommandBuffers(Instance()->_vDevice, _vAcquirePool, 1, &batch.vAcquireCommandBuffer);
+                }
+                for (auto& callback : batch.callbacks) {
+                    callbacks.emplace_back(std::move(callback));
+                }
+
+                collected = batch.ticket;
+                _inFlight.pop_front();
+            }
+        }
+
+        for (auto& callback : callbacks) {
+            callback();
+        }
+
+        if (collected != 0) {
+            std::lock_guard<std::mutex> lg(_collectedLock);
+            _collected = std::max(_collected, collected);
+            _collectedCond.notify_all();
+        }
+    }
+
+}
@@ -2,6 +2,7 @@
 #include "Rise/vertices.h"
 
 #include "Rise/gpu_allocator.h"
+#include "Rise/upload_queue.h"
 #include "Rise/rise.h"
 
 namespace Rise {
@@ -30,7 +31,12 @@ namespace Rise {
     void CustomVertices::SetupMeta(const CustomVertices::Meta& meta) {
         _meta = meta;
     }
-    void Vertices::LoadFromFile(const std::string& filename) {
+    void Vertices::LoadFromFile(const std::string& filename, const CancellationToken& token) {
+        if (token.IsCancelled()) {
+            MarkCancelled();
+            return;
+        }
+
         Data data;
         
         {
@@ -38,13 +44,14 @@ namespace Rise {
             i >> data;
         }
 
-        VkDeviceSize bufferSize = _meta->sizeOf();
+        if (token.IsCancelled()) {
+            MarkCancelled();
+            return;
+        }
 
-        _vertexBuffer = GpuAllocator::CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
-        auto stagingBuffer = GpuAllocator::CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        VkDeviceSize bufferSize = _meta->sizeOf();
 
-        {
-            auto memoryPtr = stagingBuffer.MapMemory();
+        auto write = [&](void* memoryPtr) {
             uint32_t typeIndex = 0;
             uint32_t counter = 0;
             for (auto vec : data) {
@@ -65,37 +72,109 @@ namespace Rise {
                     ++counter;
                 }
             }
+        };
+
+        _vertexBuffer = GpuAllocator::CreateDirectWriteBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+        if (_vertexBuffer.vBuffer() != VK_NULL_HANDLE) {
+            GpuAllocator::SetOwner(_vertexBuffer, filename);
+            write(_vertexBuffer.MapMemory());
+            _vertexBuffer.Flush();
+            MarkLoaded();
+
+            _relocation = GpuAllocator::SetRelocatable(_vertexBuffer, [this](GpuAllocator::Buffer buffer) {
+                _vertexBuffer = buffer;
+            });
+            return;
+        }
+
+        _vertexBuffer = GpuAllocator::CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+        if (_vertexBuffer.vBuffer() == VK_NULL_HANDLE) {
+            Error("failed to create vertex buffer " + filename);
+            MarkFailed();
+            return;
+        }
+        GpuAllocator::SetOwner(_vertexBuffer, filename);
+
+        auto stagingBuffer = Instance()->Uploads().Staging().Acquire(bufferSize);
+        if (stagingBuffer.vBuffer() == VK_NULL_HANDLE) {
+            Error("failed to get a staging buffer for " + filename);
+            GpuAllocator::DestroyBuffer(_vertexBuffer);
+            _vertexBuffer = {};
+            MarkFailed();
+            return;
         }
+        write(stagingBuffer.MapMemory());
 
-        GpuAllocator::CopyBuffer(stagingBuffer, _vertexBuffer, bufferSize);
-        GpuAllocator::DestroyBuffer(stagingBuffer);
+        _upload = Instance()->Uploads().CopyBuffer(stagingBuffer, _vertexBuffer, bufferSize, [this, stagingBuffer]() {
+            Instance()->Uploads().Staging().Release(stagingBuffer);
+            MarkLoaded();
 
-        MarkLoaded();
+            _relocation = GpuAllocator::SetRelocatable(_vertexBuffer, [this](GpuAllocator::Buffer buffer) {
+                _vertexBuffer = buffer;
+            });
+        });
     }
 
     void CustomVertices::Load(const std::vector<uint8_t>& data) {
         VkDeviceSize bufferSize = data.size();
 
-        _vertexBuffer = GpuAllocator::CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
-        auto stagingBuffer = GpuAllocator::CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        _vertexBuffer = GpuAllocator::CreateDirectWriteBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+        if (_vertexBuffer.vBuffer() != VK_NULL_HANDLE) {
+            memcpy(_vertexBuffer.MapMemory(), data.data(), data.size());
+            _vertexBuffer.Flush();
+            MarkLoaded();
+
+            _relocation = GpuAllocator::SetRelocatable(_vertexBuffer, [this](GpuAllocator::Buffer buffer) {
+                _vertexBuffer = buffer;
+            });
+            return;
+        }
+
+        _vertexBuffer = GpuAllocator::CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+        if (_vertexBuffer.vBuffer() == VK_NULL_HANDLE) {
+            Error("failed to create vertex buffer!");
+            MarkFailed();
+            return;
+        }
+
+        auto stagingBuffer = Instance()->Uploads().Staging().Acquire(bufferSize);
+        if (stagingBuffer.vBuffer() == VK_NULL_HANDLE) {
+            Error("failed to get a staging buffer for vertices!");
+            GpuAllocator::DestroyBuffer(_vertexBuffer);
+            _vertexBuffer = {};
+            MarkFailed();
+            return;
+        }
 
         {
             auto memoryPtr = stagingBuffer.MapMemory();
             memcpy(memoryPtr, data.data(), data.size());
         }
         
-        GpuAllocator::CopyBuffer(stagingBuffer, _vertexBuffer, bufferSize);
-        GpuAllocator::DestroyBuffer(stagingBuffer);
-
-        MarkLoaded();
+        _upload = Instance()->Uploads().CopyBuffer(stagingBuffer, _vertexBuffer, bufferSize, [this, stagingBuffer]() {
+            Instance()->Uploads().Staging().Release(stagingBuffer);
+            MarkLoaded();
+
+            _relocation = GpuAllocator::SetRelocatable(_vertexBuffer, [this](GpuAllocator::Buffer buffer) {
+                _vertexBuffer = buffer;
+            });
+        });
     }
 
     void Vertices::Unload() {
+        // a relocation callback mustn't swap the buffer while it's destroyed
+        if (_relocation) {
+            _relocation->Revoke();
+        }
         GpuAllocator::DestroyBuffer(_vertexBuffer);
 
         MarkUnloaded();
     }
     void CustomVertices::Unload() {
+        // a relocation callback mustn't swap the buffer while it's destroyed
+        if (_relocation) {
+            _relocation->Revoke();
+        }
         GpuAllocator::DestroyBuffer(_vertexBuffer);
 
         MarkUnloaded();